@@ -69,9 +69,9 @@
 /*! \brief major version number */
 #define HS_FINDER_VERSION_MAJOR 0
 /*! \brief minor version number */
-#define HS_FINDER_VERSION_MINOR 1
+#define HS_FINDER_VERSION_MINOR 2
 /*! \brief micro version number */
-#define HS_FINDER_VERSION_MICRO 2
+#define HS_FINDER_VERSION_MICRO 0
 /*! @} */
 
 /*! \cond PRIVATE */
@@ -111,7 +111,7 @@ struct hs_finder;
 
 /*! \brief type of pointer to function for processing matches (basically the same as hyperscan's match_event_handler)
  * \param  id              match id as specified in hs_finder_add_expr()
- * \param  from            start position of match (requires HS_FLAG_SOM_LEFTMOST flag in hs_finder_add_expr())
+ * \param  from            start position of match (requires HS_FLAG_SOM_LEFTMOST flag in hs_finder_add_expr() and start of match not disabled with hs_finder_set_som_horizon())
  * \param  to              end position of match
  * \param  flags           flags used for match (as specified in in hs_finder_add_expr())
  * \param  finder          hs_finder object
@@ -132,6 +132,26 @@ typedef int (*hs_finder_match_fn)(unsigned int id, unsigned long long from, unsi
  */
 typedef size_t (*hs_finder_output_fn) (void* callbackdata, const char* data, size_t datalen);
 
+/*! \brief data segment for searching data that is not contiguous in memory
+ * \sa     hs_finder_process_iov()
+ * \sa     hs_finder_process_block_iov()
+ */
+struct hs_finder_iovec {
+  const char* data;             /**< data of segment */
+  size_t datalen;               /**< length of segment */
+};
+
+/*! \brief type of pointer to function for processing output consisting of multiple data segments
+ * \param  callbackdata    custom data as passed to hs_finder_open_v()
+ * \param  iov             data segments to be processed in order
+ * \param  iovcnt          number of data segments
+ * \return (unused)
+ * \sa     hs_finder_open_v()
+ * \sa     hs_finder_outputv_to_stream()
+ * \sa     hs_finder_outputv_to_fd()
+ */
+typedef size_t (*hs_finder_outputv_fn) (void* callbackdata, const struct hs_finder_iovec* iov, size_t iovcnt);
+
 /*! \brief initialize hs_finder object
  * \param  matchfn         function to call for each match
  * \return allocated hs_finder object (or NULL on error)
@@ -156,6 +176,44 @@ DLL_EXPORT_HS_FINDER void hs_finder_cleanup (struct hs_finder* finder);
  */
 DLL_EXPORT_HS_FINDER void hs_finder_add_expr (struct hs_finder* finder, const char* expr, unsigned int flags, unsigned int id);
 
+/*! \brief add literal search string to hs_finder object
+ * \param  finder          hs_finder object
+ * \param  literal         string to search for (may contain any byte, including null characters)
+ * \param  literallen      length of \p literal in bytes (empty strings are ignored)
+ * \param  flags           matching flags (only HS_FLAG_CASELESS, HS_FLAG_SINGLEMATCH and HS_FLAG_SOM_LEFTMOST are used)
+ * \param  id              matching id
+ * \sa     hs_finder_add_expr()
+ *
+ * The string is matched as is, no characters need to be escaped.
+ * A search instance with only literal strings is compiled with the literal compiler of Hyperscan, which is much faster
+ * and produces smaller databases for large lists of strings.
+ * When a search instance also has regular expressions the literal strings are compiled as escaped regular expressions,
+ * so add them to a separate search instance with hs_finder_add_instance() to keep the benefit.
+ * hs_finder_get_profile() returns the escaped regular expression as expression.
+ */
+DLL_EXPORT_HS_FINDER void hs_finder_add_literal (struct hs_finder* finder, const char* literal, size_t literallen, unsigned int flags, unsigned int id);
+
+/*! \brief set replacement for matches of an expression id
+ * \param  finder          hs_finder object
+ * \param  id              matching id as specified in hs_finder_add_expr()
+ * \param  replacement     data to replace matches with (may be NULL if \p replacementlen is 0 to remove matches)
+ * \param  replacementlen  length of \p replacement
+ * \return zero on success
+ * \sa     hs_finder_add_expr()
+ * \sa     hs_finder_set_overlap_policy()
+ * \sa     hs_finder_get_replacement_count()
+ *
+ * Applies to the last search instance, like hs_finder_add_expr().
+ * Matches of expressions with a replacement are handled by the library instead of the match function:
+ * they are collected until it is certain no overlapping match can be found anymore, overlapping matches are resolved according to the overlap policy
+ * and the matched data is replaced in the output without calling hs_finder_flush(), hs_finder_skip() and hs_finder_output() from the match function.
+ * The expressions must be added with the HS_FLAG_SOM_LEFTMOST flag.
+ * Matches of other expressions of the same search instance are still passed to the match function (if not NULL),
+ * which may then not flush, skip or output data.
+ * Setting the replacement again for the same id overwrites the previous one. The data is copied.
+ */
+DLL_EXPORT_HS_FINDER int hs_finder_set_replacement (struct hs_finder* finder, unsigned int id, const char* replacement, size_t replacementlen);
+
 /*! \brief add search instance to hs_finder object
  * \param  finder          hs_finder object
  * \param  matchfn         function to call for each match
@@ -164,6 +222,194 @@ DLL_EXPORT_HS_FINDER void hs_finder_add_expr (struct hs_finder* finder, const ch
  */
 DLL_EXPORT_HS_FINDER void hs_finder_add_instance (struct hs_finder* finder, hs_finder_match_fn matchfn, void* callbackdata);
 
+/*! \brief create hs_finder object for another data stream sharing the compiled expressions
+ * \param  finder          hs_finder object that was opened at least once with hs_finder_open(), hs_finder_open_scan_only() or hs_finder_process_block()
+ * \param  callbackdata    custom data for the match functions of all search instances of the new object (if NULL the callback data of \p finder is used)
+ * \return allocated hs_finder object (or NULL on error)
+ * \sa     hs_finder_open()
+ * \sa     hs_finder_cleanup()
+ *
+ * The new object has the same search instances, match functions and settings as \p finder, but its own streams and buffers.
+ * The compiled databases are shared instead of compiled again, so many data streams can be searched at a fraction of the memory and startup cost.
+ * Scratch space is shared too, an extra copy is only allocated for each thread scanning with the same database at the same time.
+ * Different hs_finder objects sharing compiled expressions can be used concurrently from different threads.
+ * The new object must be opened with hs_finder_open() or hs_finder_open_scan_only() and freed with hs_finder_cleanup(),
+ * \p finder may be freed before it.
+ * Adding expressions to either object afterwards doesn't affect the other one.
+ */
+DLL_EXPORT_HS_FINDER struct hs_finder* hs_finder_create_stream (struct hs_finder* finder, void* callbackdata);
+
+/*! \brief value returned by hs_finder_get_split_overlap() if data can't be searched in parts
+ * \sa     hs_finder_get_split_overlap()
+ */
+#define HS_FINDER_NO_SPLIT ((size_t)-1)
+
+/*! \brief get number of bytes by which parts of the data must overlap to search them separately
+ * \param  finder          hs_finder object
+ * \return maximum match width of all expressions of all search instances
+ *         (or HS_FINDER_NO_SPLIT if an expression can match an unlimited number of bytes or can match at the end of the data)
+ * \sa     hs_finder_create_stream()
+ * \sa     hs_finder_open_scan_only()
+ *
+ * When searching without output (see hs_finder_open_scan_only()), data can be split in parts that are searched in parallel,
+ * each with its own stream created with hs_finder_create_stream().
+ * To find all matches each part (except the first one) must start this number of bytes before the end of the previous part,
+ * and matches ending in the overlap (at a position less than or equal to the overlap) must be ignored,
+ * as they are found in the previous part.
+ */
+DLL_EXPORT_HS_FINDER size_t hs_finder_get_split_overlap (struct hs_finder* finder);
+
+/*! \brief start of match horizon constants, determine how far back the start of a match is reported exactly in stream mode
+ * \sa     hs_finder_set_som_horizon()
+ * \name   HS_FINDER_SOM_*
+ * \{
+ */
+/*! \brief don't report the start of matches (HS_FLAG_SOM_LEFTMOST is ignored and from is always 0) */
+#define HS_FINDER_SOM_NONE 0
+/*! \brief report the start of matches within 2^16 bytes of the end (default) */
+#define HS_FINDER_SOM_HORIZON_SMALL 1
+/*! \brief report the start of matches within 2^32 bytes of the end */
+#define HS_FINDER_SOM_HORIZON_MEDIUM 2
+/*! \brief report the start of matches at any distance from the end */
+#define HS_FINDER_SOM_HORIZON_LARGE 3
+/*! @} */
+
+/*! \brief set how far back the start of matches is reported
+ * \param  finder          hs_finder object
+ * \param  horizon         one of the HS_FINDER_SOM_* values (other values are ignored)
+ * \sa     hs_finder_add_expr()
+ * \sa     hs_finder_open()
+ *
+ * Applies to the last search instance and to instances added after it with hs_finder_add_instance(), takes effect on the next call to hs_finder_open().
+ * Only matters for expressions added with the HS_FLAG_SOM_LEFTMOST flag.
+ * A smaller horizon means less stream state to keep for each stream.
+ * If the match functions don't use the from parameter, HS_FINDER_SOM_NONE removes the HS_FLAG_SOM_LEFTMOST flag from all expressions
+ * of the search instance, which makes both the stream state and scanning cheaper.
+ * Search instances with replacements can't be compiled without start of match.
+ */
+DLL_EXPORT_HS_FINDER void hs_finder_set_som_horizon (struct hs_finder* finder, int horizon);
+
+/*! \brief set platform for which search expressions are compiled
+ * \param  finder          hs_finder object
+ * \param  platform        target platform (tune and cpu_features, for example as filled in by hs_populate_platform()), or NULL for the current host (default)
+ * \sa     hs_finder_open()
+ * \sa     hs_finder_set_cache_dir()
+ *
+ * Applies to the last search instance and to instances added after it with hs_finder_add_instance(), takes effect on the next call to hs_finder_open().
+ * Setting cpu_features to HS_CPU_FEATURES_AVX2 or HS_CPU_FEATURES_AVX512 and tune to the HS_TUNE_FAMILY_* value of the machines doing the search
+ * can be used to build a cache directory for those machines on another one.
+ * The platform data is copied.
+ */
+DLL_EXPORT_HS_FINDER void hs_finder_set_platform (struct hs_finder* finder, const hs_platform_info_t* platform);
+
+/*! \brief set directory for caching compiled search expressions
+ * \param  finder          hs_finder object
+ * \param  path            directory where compiled databases are stored and loaded from (NULL to disable caching)
+ * \sa     hs_finder_open()
+ *
+ * Applies to all search instances, including instances added later with hs_finder_add_instance().
+ * Cached databases are identified by a hash of the expressions, flags, ids, compile mode, start of match horizon, platform and Hyperscan version.
+ * Without hs_finder_set_platform() the platform of the current host is used, so a cache directory can be shared by hosts with different CPU features.
+ * If no usable cached database is found (or it can't be used on this host) the expressions are compiled and the result is saved in the cache directory.
+ * The directory must already exist.
+ */
+DLL_EXPORT_HS_FINDER void hs_finder_set_cache_dir (struct hs_finder* finder, const char* path);
+
+/*! \brief set maximum size of data buffered for search instances with expressions that can match data of unlimited length
+ * \param  finder          hs_finder object
+ * \param  maxbuffersize   maximum number of bytes to keep buffered (0 for unlimited)
+ * \sa     hs_finder_process()
+ *
+ * Applies to all search instances, including instances added later with hs_finder_add_instance().
+ * When all expressions of a search instance have a maximum match width, data that can no longer be part of a match is
+ * flushed automatically after each call to hs_finder_process() and this setting is not used.
+ * Otherwise, when more than \p maxbuffersize bytes are buffered, the oldest data is flushed, even if it could still be part of a match.
+ * The default value is 1024 (can be changed at compile time by defining HS_MAX_BUFFER_SIZE).
+ */
+DLL_EXPORT_HS_FINDER void hs_finder_set_max_buffer_size (struct hs_finder* finder, size_t maxbuffersize);
+
+/*! \brief enable or disable running each search instance in its own thread
+ * \param  finder          hs_finder object
+ * \param  pipeline        non-zero to run search instances in separate threads, zero to run them in the calling thread (default)
+ * \sa     hs_finder_add_instance()
+ * \sa     hs_finder_open()
+ * \sa     hs_finder_close()
+ *
+ * Applies to all search instances, including instances added later with hs_finder_add_instance(), and takes effect on the next call to hs_finder_open().
+ * In pipelined mode the first search instance still runs in the thread calling hs_finder_process(),
+ * the output of each search instance is passed to the thread of the next one through a bounded queue of buffers.
+ * The order of the output is the same as without threads, but the match functions of all but the first search instance
+ * and the output function are called from other threads, so callback data shared between search instances must be thread-safe.
+ * hs_finder_close() waits until all search instances have finished.
+ * Has no effect with hs_finder_open_scan_only().
+ */
+DLL_EXPORT_HS_FINDER void hs_finder_set_pipeline (struct hs_finder* finder, int pipeline);
+
+/*! \brief overlap policy constants, determine which matches are replaced when matches of expressions with a replacement overlap
+ * \sa     hs_finder_set_overlap_policy()
+ * \name   HS_FINDER_OVERLAP_*
+ * \{
+ */
+/*! \brief replace the match starting first, the longest one if several start at the same position (default) */
+#define HS_FINDER_OVERLAP_LEFTMOST_LONGEST 0
+/*! \brief replace the match starting first, the shortest one if several start at the same position */
+#define HS_FINDER_OVERLAP_FIRST_START 1
+/*! \brief replace the match with the lowest id, the leftmost longest one if several have the same id */
+#define HS_FINDER_OVERLAP_PRIORITY 2
+/*! @} */
+
+/*! \brief set size of buffer collecting output before passing it to the output function
+ * \param  finder          hs_finder object
+ * \param  outputbuffersize number of bytes to collect before calling the output function (0 to call it for every piece of output (default))
+ * \sa     hs_finder_open()
+ * \sa     hs_finder_open_v()
+ * \sa     hs_finder_process_block()
+ *
+ * Applies to all search instances, including instances added later with hs_finder_add_instance(), and takes effect on the next call to
+ * hs_finder_open(), hs_finder_open_v() or hs_finder_process_block().
+ * Without output buffer the output function is called for every piece of data flushed and every replacement,
+ * which means many small writes when matches are frequent.
+ * With an output buffer the pieces are collected until at least \p outputbuffersize bytes are available
+ * and then passed to the output function in one call (copied into one chunk)
+ * or to the function set with hs_finder_open_v() as list of segments (referring to the buffered input data and replacements without copying them,
+ * only data not passed on by the end of hs_finder_process() is copied as the buffered data may be moved afterwards).
+ * The remaining output is passed on by hs_finder_close().
+ */
+DLL_EXPORT_HS_FINDER void hs_finder_set_output_buffer_size (struct hs_finder* finder, size_t outputbuffersize);
+
+/*! \brief set which matches are replaced when matches of expressions with a replacement overlap
+ * \param  finder          hs_finder object
+ * \param  policy          one of the HS_FINDER_OVERLAP_* values
+ * \sa     hs_finder_set_replacement()
+ *
+ * Applies to all search instances, including instances added later with hs_finder_add_instance().
+ * After the preferred match is chosen, the other matches overlapping it are discarded and the choice is repeated for the remaining ones.
+ */
+DLL_EXPORT_HS_FINDER void hs_finder_set_overlap_policy (struct hs_finder* finder, int policy);
+
+/*! \brief enable or disable keeping statistics for each pattern id
+ * \param  finder          hs_finder object
+ * \param  profiling       non-zero to enable profiling, zero to disable it (default)
+ * \sa     hs_finder_get_profile()
+ * \sa     hs_finder_write_profile()
+ *
+ * Applies to all search instances, including instances added later with hs_finder_add_instance(), and takes effect on the next call to
+ * hs_finder_open(), hs_finder_open_v(), hs_finder_open_scan_only() or the hs_finder_process_block() functions.
+ * Profiling costs a lookup of the pattern id and reading a monotonic clock twice for every match and calls hs_expression_info() for every expression when opened,
+ * so it is meant for finding out which expressions are expensive, not for use in production.
+ */
+DLL_EXPORT_HS_FINDER void hs_finder_set_profiling (struct hs_finder* finder, int profiling);
+
+/*! \brief get number of matches replaced for an expression id
+ * \param  finder          hs_finder object
+ * \param  id              matching id as specified in hs_finder_set_replacement()
+ * \return number of matches replaced by all search instances since the stream was opened (or since hs_finder_process_block() was called)
+ * \sa     hs_finder_set_replacement()
+ *
+ * Should be called after hs_finder_close(), as matches are only replaced when it is certain no overlapping match can be found anymore.
+ */
+DLL_EXPORT_HS_FINDER size_t hs_finder_get_replacement_count (struct hs_finder* finder, unsigned int id);
+
 /*! \brief function (of type hs_finder_output_fn) to write data to a FILE* stream
  * \param  callbackdata    output stream (of type FILE*)
  * \param  data            data to be written
@@ -173,6 +419,26 @@ DLL_EXPORT_HS_FINDER void hs_finder_add_instance (struct hs_finder* finder, hs_f
  */
 DLL_EXPORT_HS_FINDER size_t hs_finder_output_to_stream (void* callbackdata, const char* data, size_t datalen);
 
+/*! \brief function (of type hs_finder_outputv_fn) to write data segments to a FILE* stream
+ * \param  callbackdata    output stream (of type FILE*)
+ * \param  iov             data segments to be written
+ * \param  iovcnt          number of data segments
+ * \return number of bytes written
+ * \sa     hs_finder_outputv_fn
+ */
+DLL_EXPORT_HS_FINDER size_t hs_finder_outputv_to_stream (void* callbackdata, const struct hs_finder_iovec* iov, size_t iovcnt);
+
+/*! \brief function (of type hs_finder_outputv_fn) to write data segments to a file descriptor
+ * \param  callbackdata    pointer to file descriptor (of type int*)
+ * \param  iov             data segments to be written
+ * \param  iovcnt          number of data segments
+ * \return number of bytes written
+ * \sa     hs_finder_outputv_fn
+ *
+ * Uses writev() to write multiple segments with one system call (on Windows the segments are written one by one).
+ */
+DLL_EXPORT_HS_FINDER size_t hs_finder_outputv_to_fd (void* callbackdata, const struct hs_finder_iovec* iov, size_t iovcnt);
+
 /*! \brief function (of type hs_finder_output_fn) to discard data
  * \param  callbackdata    not used
  * \param  data            data to be written
@@ -190,9 +456,42 @@ DLL_EXPORT_HS_FINDER size_t hs_finder_output_to_null (void* callbackdata, const
  * \sa     hs_finder_process()
  * \sa     hs_finder_close()
  * \sa     hs_finder_output_fn
+ *
+ * Only search instances to which expressions were added since the previous call to hs_finder_open() are compiled again,
+ * the others reuse their compiled database, scratch space and stream.
+ * If multiple search instances need to be compiled this is done at the same time in separate threads.
  */
 DLL_EXPORT_HS_FINDER hs_error_t hs_finder_open (struct hs_finder* finder, hs_finder_output_fn outputfn, void* callbackdata);
 
+/*! \brief open data stream for searching, with output passed on in large batches of data segments
+ * \param  finder          hs_finder object
+ * \param  outputvfn       function to call for processing output
+ * \param  callbackdata    custom data to be passed to \p outputvfn
+ * \return HS_SUCCESS on success
+ * \sa     hs_finder_open()
+ * \sa     hs_finder_set_output_buffer_size()
+ * \sa     hs_finder_outputv_fn
+ *
+ * Same as hs_finder_open(), but the output is collected in an output buffer (see hs_finder_set_output_buffer_size(),
+ * 64 KB if no size was set) and passed to \p outputvfn as list of data segments.
+ */
+DLL_EXPORT_HS_FINDER hs_error_t hs_finder_open_v (struct hs_finder* finder, hs_finder_outputv_fn outputvfn, void* callbackdata);
+
+/*! \brief open data stream for searching only, without buffering or generating output
+ * \param  finder          hs_finder object
+ * \return HS_SUCCESS on success
+ * \sa     hs_finder_open()
+ * \sa     hs_finder_process()
+ * \sa     hs_finder_close()
+ *
+ * Data passed to hs_finder_process() is scanned directly by every search instance and is never copied,
+ * so memory use doesn't depend on the amount of data processed.
+ * As there is no output all search instances see the unmodified input data.
+ * The match functions only receive offsets: hs_finder_flush(), hs_finder_skip() and hs_finder_output() have no effect
+ * and hs_finder_get_buf_at_pos() always returns NULL.
+ */
+DLL_EXPORT_HS_FINDER hs_error_t hs_finder_open_scan_only (struct hs_finder* finder);
+
 /*! \brief process chunk of data for searching
  * \param  finder          hs_finder object
  * \param  data            data to be processed
@@ -202,17 +501,175 @@ DLL_EXPORT_HS_FINDER hs_error_t hs_finder_open (struct hs_finder* finder, hs_fin
  * \sa     hs_finder_close()
  * \sa     hs_finder_add_expr()
  * \sa     hs_finder_add_instance()
+ *
+ * \p data is searched and flushed where it is: data that can no longer be part of a match is passed to the output function
+ * (or the next search instance) directly from \p data, only the data at the end that can still be part of a match is copied
+ * before returning. Pointers to buffered data obtained in the match function are only valid until the match function returns.
  */
 DLL_EXPORT_HS_FINDER hs_error_t hs_finder_process (struct hs_finder* finder, const char* data, size_t datalen);
 
+/*! \brief process data segments for searching
+ * \param  finder          hs_finder object
+ * \param  iov             data segments to be processed in order
+ * \param  iovcnt          number of data segments
+ * \return HS_SUCCESS on success
+ * \sa     hs_finder_process()
+ * \sa     hs_finder_process_block_iov()
+ *
+ * Gives the same result as calling hs_finder_process() for each segment, for data that is only part of a record,
+ * but all segments are buffered and scanned before data is flushed once, and only the data at the end that can still be part of a match is copied.
+ * Use hs_finder_process_block_iov() instead when the segments contain the complete data.
+ */
+DLL_EXPORT_HS_FINDER hs_error_t hs_finder_process_iov (struct hs_finder* finder, const struct hs_finder_iovec* iov, size_t iovcnt);
+
+/*! \brief release memory used by an idle data stream until more data is processed
+ * \param  finder          hs_finder object
+ * \return HS_SUCCESS on success, HS_INVALID if search instances are running in their own threads
+ * \sa     hs_finder_resume()
+ * \sa     hs_finder_create_stream()
+ * \sa     hs_finder_set_pipeline()
+ *
+ * Meant for applications keeping many streams open (e.g. one per network connection) of which only a few receive data at any time.
+ * For each search instance the state of the Hyperscan stream is saved in compressed form and the stream itself is released,
+ * the buffered data is reduced to the data that can still be part of a match and the output buffer is flushed and freed.
+ * Scratch space is only used while scanning, so it is shared with other streams anyway.
+ * Released streams are kept for reuse by streams of the same pattern set being resumed
+ * (up to 16 for all streams created from the same search instance, can be changed at compile time by defining HS_STREAM_POOL_SIZE).
+ * Calling hs_finder_process() or hs_finder_close() resumes the data stream automatically.
+ * In pipelined mode this can only be called after hs_finder_close().
+ */
+DLL_EXPORT_HS_FINDER hs_error_t hs_finder_suspend (struct hs_finder* finder);
+
+/*! \brief restore data stream suspended with hs_finder_suspend()
+ * \param  finder          hs_finder object
+ * \return HS_SUCCESS on success
+ * \sa     hs_finder_suspend()
+ *
+ * The state of the Hyperscan stream of each search instance is expanded into a released stream if available, otherwise into a new one.
+ * There is no need to call this before hs_finder_process() or hs_finder_close() as they do this automatically,
+ * but it can be used to avoid the delay when the next data arrives.
+ */
+DLL_EXPORT_HS_FINDER hs_error_t hs_finder_resume (struct hs_finder* finder);
+
 /*! \brief close data stream
  * \param  finder          hs_finder object
  * \return HS_SUCCESS on success
  * \sa     hs_finder_open()
  * \sa     hs_finder_process()
+ *
+ * Matches at the end of the data are reported before the remaining data is flushed.
+ * The compiled databases are kept until hs_finder_cleanup(), so hs_finder_open() can be called again without recompiling.
  */
 DLL_EXPORT_HS_FINDER hs_error_t hs_finder_close (struct hs_finder* finder);
 
+/*! \brief pass on all output collected in output buffers
+ * \param  finder          hs_finder object
+ * \sa     hs_finder_set_output_buffer_size()
+ * \sa     hs_finder_open_v()
+ *
+ * Output is normally passed to the output function when the output buffer is full or when hs_finder_close() is called.
+ * This can be used when the output up to the data processed so far is needed earlier, e.g. before saving a checkpoint.
+ * In pipelined mode this can only be called after hs_finder_close().
+ */
+DLL_EXPORT_HS_FINDER void hs_finder_flush_output (struct hs_finder* finder);
+
+/*! \brief save state of data stream to checkpoint file, so an interrupted search can be continued later
+ * \param  finder          hs_finder object
+ * \param  filename        path of checkpoint file (replaced if it already exists)
+ * \param  inputpos        number of input bytes processed so far
+ * \param  appdata         data of the application to save with the checkpoint (e.g. counters updated by the match function), or NULL
+ * \param  appdatalen      number of bytes in \p appdata
+ * \return HS_SUCCESS on success, HS_INVALID if not all search instances were opened or if they are running in their own threads
+ * \sa     hs_finder_load_checkpoint()
+ * \sa     hs_finder_flush_output()
+ *
+ * For each search instance the compressed state of the Hyperscan stream, the buffered data that can still be part of a match,
+ * matches not replaced yet and the counters (replacement counts, statistics and statistics for each pattern id) are saved.
+ * The output buffers are flushed first, so the output written so far corresponds to the saved state.
+ * The checkpoint file is written as a temporary file (\p filename with ".tmp" appended) that replaces \p filename when it is complete,
+ * so the previous checkpoint remains usable if writing is interrupted.
+ * Checkpoint files can only be loaded on a system with the same Hyperscan version and byte order.
+ * In pipelined mode this can only be called after hs_finder_close().
+ */
+DLL_EXPORT_HS_FINDER hs_error_t hs_finder_save_checkpoint (struct hs_finder* finder, const char* filename, unsigned long long inputpos, const void* appdata, size_t appdatalen);
+
+/*! \brief restore state of data stream from checkpoint file
+ * \param  finder          hs_finder object, opened with hs_finder_open(), hs_finder_open_v() or hs_finder_open_scan_only()
+ * \param  filename        path of checkpoint file saved with hs_finder_save_checkpoint()
+ * \param  inputpos        pointer where the number of input bytes processed before the checkpoint will be stored
+ * \param  appdata         buffer where the data of the application saved with the checkpoint will be stored, or NULL
+ * \param  appdatalen      number of bytes in \p appdata (must be the same as when the checkpoint was saved)
+ * \return HS_SUCCESS on success, HS_INVALID if the checkpoint file can't be read or was saved with different search instances or expressions
+ * \sa     hs_finder_save_checkpoint()
+ *
+ * After loading the checkpoint, processing must continue with the input data after the first \p inputpos bytes.
+ * The output of the data stream continues after the output written up to the checkpoint, so the application must discard
+ * any output written after the checkpoint was saved (e.g. by truncating the output file to the size saved in \p appdata).
+ * If loading fails the state of the data stream is undefined and it must be opened again to start from the beginning.
+ */
+DLL_EXPORT_HS_FINDER hs_error_t hs_finder_load_checkpoint (struct hs_finder* finder, const char* filename, unsigned long long* inputpos, void* appdata, size_t appdatalen);
+
+/*! \brief search complete data in memory
+ * \param  finder          hs_finder object
+ * \param  data            data to be processed
+ * \param  datalen         length of data to be processed (at most 4 GB)
+ * \param  outputfn        function to call for processing output (if NULL will use hs_finder_output_to_stream)
+ * \param  callbackdata    custom data to be passed to \p outputfn
+ * \return HS_SUCCESS on success
+ * \sa     hs_finder_process_block_scan_only()
+ * \sa     hs_finder_open()
+ * \sa     hs_finder_output_fn
+ *
+ * Gives the same result as hs_finder_open(), hs_finder_process() and hs_finder_close() with all data at once,
+ * but the expressions are compiled in block mode, which scans faster and doesn't need to keep stream state.
+ * The first search instance flushes, skips and outputs directly from \p data without copying it,
+ * the output of each search instance is collected in memory and then searched by the next instance.
+ * The block mode databases are compiled (or loaded from the cache directory) on the first call and kept until hs_finder_cleanup().
+ * Must not be called between hs_finder_open() and hs_finder_close().
+ */
+DLL_EXPORT_HS_FINDER hs_error_t hs_finder_process_block (struct hs_finder* finder, const char* data, size_t datalen, hs_finder_output_fn outputfn, void* callbackdata);
+
+/*! \brief search complete data in memory without generating output
+ * \param  finder          hs_finder object
+ * \param  data            data to be processed
+ * \param  datalen         length of data to be processed (at most 4 GB)
+ * \return HS_SUCCESS on success
+ * \sa     hs_finder_process_block()
+ * \sa     hs_finder_open_scan_only()
+ *
+ * Gives the same result as hs_finder_open_scan_only(), hs_finder_process() and hs_finder_close() with all data at once,
+ * using block mode databases like hs_finder_process_block().
+ */
+DLL_EXPORT_HS_FINDER hs_error_t hs_finder_process_block_scan_only (struct hs_finder* finder, const char* data, size_t datalen);
+
+/*! \brief search complete data in memory consisting of multiple segments
+ * \param  finder          hs_finder object
+ * \param  iov             data segments to be processed in order (each at most 4 GB)
+ * \param  iovcnt          number of data segments
+ * \param  outputfn        function to call for processing output (if NULL will use hs_finder_output_to_stream)
+ * \param  callbackdata    custom data to be passed to \p outputfn
+ * \return HS_SUCCESS on success
+ * \sa     hs_finder_process_block()
+ * \sa     hs_finder_process_block_iov_scan_only()
+ * \sa     hs_finder_get_buf_span()
+ *
+ * Same as hs_finder_process_block() with the segments concatenated, but the expressions are compiled in vectored mode
+ * and the segments are searched with a single call to hs_scan_vector() without copying them.
+ * Match positions are positions in the concatenated data and matches can span segments.
+ * The first search instance flushes and outputs directly from the segments, which may result in one call to the output function per segment.
+ */
+DLL_EXPORT_HS_FINDER hs_error_t hs_finder_process_block_iov (struct hs_finder* finder, const struct hs_finder_iovec* iov, size_t iovcnt, hs_finder_output_fn outputfn, void* callbackdata);
+
+/*! \brief search complete data in memory consisting of multiple segments without generating output
+ * \param  finder          hs_finder object
+ * \param  iov             data segments to be processed in order (each at most 4 GB)
+ * \param  iovcnt          number of data segments
+ * \return HS_SUCCESS on success
+ * \sa     hs_finder_process_block_iov()
+ * \sa     hs_finder_process_block_scan_only()
+ */
+DLL_EXPORT_HS_FINDER hs_error_t hs_finder_process_block_iov_scan_only (struct hs_finder* finder, const struct hs_finder_iovec* iov, size_t iovcnt);
+
 /*! \brief get position in input data stream
  * \param  finder          hs_finder object
  * \return current position in input data stream
@@ -237,6 +694,20 @@ DLL_EXPORT_HS_FINDER size_t hs_finder_get_pos (struct hs_finder* finder);
  */
 DLL_EXPORT_HS_FINDER const char* hs_finder_get_buf_at_pos (struct hs_finder* finder, size_t pos);
 
+/*! \brief get buffer with data starting at position in input data stream and the number of contiguous bytes available there
+ * \param  finder          hs_finder object
+ * \param  pos             position in input data stream
+ * \param  len             pointer to variable receiving number of bytes available at returned buffer (0 if not buffered)
+ * \return buffer with data at \p pos (or NULL if not buffered)
+ * \sa     hs_finder_get_buf_at_pos()
+ * \sa     hs_finder_process_block_iov()
+ *
+ * With hs_finder_process_block_iov() the buffered data may consist of multiple segments,
+ * hs_finder_get_buf_at_pos() then has to copy the data to make it contiguous, this function never copies data
+ * and only returns the part of the segment containing \p pos.
+ */
+DLL_EXPORT_HS_FINDER const char* hs_finder_get_buf_span (struct hs_finder* finder, size_t pos, size_t* len);
+
 /*! \brief get callback data, to be used inside hs_finder_match_fn
  * \param  finder          hs_finder object
  * \return callback data
@@ -287,6 +758,88 @@ DLL_EXPORT_HS_FINDER size_t hs_finder_skip (struct hs_finder* finder, size_t flu
  */
 DLL_EXPORT_HS_FINDER size_t hs_finder_output (struct hs_finder* finder, const char* data, size_t datalen);
 
+/*! \brief runtime statistics of a search instance
+ * \sa     hs_finder_get_stats()
+ */
+struct hs_finder_stats {
+  unsigned long long bytesscanned;      /**< number of bytes scanned */
+  unsigned long long matches;           /**< number of matches reported by hyperscan */
+  unsigned long long bytesflushed;      /**< number of input bytes passed to the output */
+  unsigned long long bytesskipped;      /**< number of input bytes discarded */
+  unsigned long long bytesoutput;       /**< number of bytes passed to the output (flushed input data, replacements and data sent with hs_finder_output()) */
+  size_t buffersize;                    /**< number of input bytes currently buffered */
+  size_t peakbuffersize;                /**< largest number of input bytes buffered */
+  size_t databasesize;                  /**< size of compiled expressions (for all compile modes used) */
+  size_t streamsize;                    /**< size of stream state */
+  size_t scratchsize;                   /**< size of all scratch space allocated for the compiled expressions */
+  unsigned long long scantime;          /**< time spent scanning in hyperscan in nanoseconds (excluding time spent in match functions) */
+  unsigned long long callbacktime;      /**< time spent in match functions in nanoseconds (estimated from a sample of the calls unless profiling is enabled, see hs_finder_set_profiling()) */
+};
+
+/*! \brief get runtime statistics of each search instance
+ * \param  finder          hs_finder object
+ * \param  stats           array receiving statistics of the search instances in order (may be NULL if \p maxstats is 0)
+ * \param  maxstats        maximum number of elements to fill in \p stats
+ * \return number of search instances (may be more than \p maxstats)
+ * \sa     hs_finder_open()
+ * \sa     hs_finder_process_block()
+ * \sa     hs_finder_close()
+ *
+ * Counters and times are reset by hs_finder_open(), hs_finder_open_scan_only() and the hs_finder_process_block() functions,
+ * so after hs_finder_close() they cover the last run.
+ * Keeping track of them is cheap, the only overhead is reading a monotonic clock before and after each call to hyperscan and around one in every 64 calls to the match function.
+ * The time spent in the match function is estimated by counting each call that isn't timed at the time of the last call that was,
+ * only when profiling is enabled with hs_finder_set_profiling() every call is timed.
+ * The sizes of compiled expressions and scratch space are shared with the hs_finder objects created with hs_finder_create_stream().
+ * This function must not be called while data is being processed.
+ */
+DLL_EXPORT_HS_FINDER size_t hs_finder_get_stats (struct hs_finder* finder, struct hs_finder_stats* stats, size_t maxstats);
+
+/*! \brief statistics of a pattern id, with information about its expressions as reported by hs_expression_info()
+ * \sa     hs_finder_get_profile()
+ */
+struct hs_finder_pattern_profile {
+  size_t instance;                      /**< index of search instance */
+  unsigned int id;                      /**< matching id */
+  const char* expression;               /**< first expression with this id (valid as long as expressions aren't added and the hs_finder object isn't cleaned up) */
+  size_t expressions;                   /**< number of expressions with this id */
+  unsigned int minwidth;                /**< minimum number of bytes a match can span */
+  unsigned int maxwidth;                /**< maximum number of bytes a match can span (UINT_MAX if unlimited) */
+  int anchored;                         /**< non-zero if all expressions only match at the start of the data */
+  int matchesateod;                     /**< non-zero if an expression can match at the end of the data */
+  int matchesonlyateod;                 /**< non-zero if all expressions only match at the end of the data */
+  unsigned long long matches;           /**< number of matches */
+  unsigned long long callbacktime;      /**< time spent in the match function for matches of this id in nanoseconds (for ids with a replacement: time spent choosing and applying replacements) */
+  unsigned long long retainedbytes;     /**< number of bytes kept in the buffer at the end of hs_finder_process() because a match of this id was waiting to be replaced (summed over all calls) */
+};
+
+/*! \brief get statistics for each pattern id of all search instances
+ * \param  finder          hs_finder object
+ * \param  profile         array receiving the statistics, sorted by search instance and id (may be NULL if \p maxprofile is 0)
+ * \param  maxprofile      maximum number of elements to fill in \p profile
+ * \return number of pattern ids of all search instances (may be more than \p maxprofile, 0 if profiling is not enabled)
+ * \sa     hs_finder_set_profiling()
+ * \sa     hs_finder_write_profile()
+ *
+ * Statistics are reset by hs_finder_open(), hs_finder_open_v(), hs_finder_open_scan_only() and the hs_finder_process_block() functions.
+ * hs_finder_create_stream() objects sharing the same expressions return their ids in the same order, so their statistics can be added up.
+ * This function must not be called while data is being processed.
+ */
+DLL_EXPORT_HS_FINDER size_t hs_finder_get_profile (struct hs_finder* finder, struct hs_finder_pattern_profile* profile, size_t maxprofile);
+
+/*! \brief write table of the most expensive pattern ids
+ * \param  profile         statistics as returned by hs_finder_get_profile()
+ * \param  profilecount    number of elements in \p profile
+ * \param  top             maximum number of pattern ids to list (0 for all)
+ * \param  dst             stream to write the table to
+ * \sa     hs_finder_get_profile()
+ *
+ * Pattern ids are listed by time spent in the match function, then by bytes retained and then by number of matches.
+ * The flags column shows A for anchored expressions, E for expressions that can match at the end of the data
+ * and O for expressions that only match at the end of the data.
+ */
+DLL_EXPORT_HS_FINDER void hs_finder_write_profile (const struct hs_finder_pattern_profile* profile, size_t profilecount, size_t top, FILE* dst);
+
 #ifdef __cplusplus
 }
 #endif
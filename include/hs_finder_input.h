@@ -0,0 +1,131 @@
+/*
+ * Copyright (c) 2026, Brecht Sanders
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of Intel Corporation nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+ /**
+ * @file      hs_finder_input.h
+ * @brief     hs_finder header file with functions for reading input data
+ * @author    Brecht Sanders
+ * @date      2026
+ * @copyright BSD
+ *
+ * This header file defines the functions needed to read input data efficiently to pass it to hs_finder_process().
+ * Regular files are memory mapped and returned in large windows without copying,
+ * other input (like pipes or standard input) is read in large buffers by a separate thread,
+ * so reading the next buffer overlaps with processing the previous one.
+ * Compressed input can be decompressed in the same separate thread.
+ */
+
+#ifndef INCLUDED_HS_FINDER_INPUT_H
+#define INCLUDED_HS_FINDER_INPUT_H
+
+#include "hs_finder.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*! \brief hs_finder_input object type */
+struct hs_finder_input;
+
+/*! \brief open input file
+ * \param  filename        path of file to read (or NULL to read from standard input)
+ * \return allocated hs_finder_input object (or NULL on error)
+ * \sa     hs_finder_input_read()
+ * \sa     hs_finder_input_close()
+ */
+DLL_EXPORT_HS_FINDER struct hs_finder_input* hs_finder_input_open (const char* filename);
+
+/*! \brief open input file that may be compressed
+ * \param  filename        path of file to read (or NULL to read from standard input)
+ * \return allocated hs_finder_input object (or NULL on error)
+ * \sa     hs_finder_input_open()
+ * \sa     hs_finder_input_read()
+ * \sa     hs_finder_input_close()
+ *
+ * The compression format is detected from the first bytes of the data,
+ * gzip is supported if the library was built with zlib and zstd if it was built with zstd,
+ * other data is returned as is.
+ * Compressed data is decompressed by a separate thread into a few reusable buffers,
+ * so decompression overlaps with processing the data returned by hs_finder_input_read().
+ * hs_finder_input_get_size() returns the size of the compressed file.
+ */
+DLL_EXPORT_HS_FINDER struct hs_finder_input* hs_finder_input_open_decompress (const char* filename);
+
+/*! \brief open part of input file
+ * \param  filename        path of file to read
+ * \param  offset          position in file where reading starts
+ * \param  length          maximum number of bytes to read
+ * \return allocated hs_finder_input object (or NULL on error)
+ * \sa     hs_finder_input_open()
+ * \sa     hs_finder_input_get_size()
+ *
+ * Can be used to search different parts of the same file in parallel.
+ */
+DLL_EXPORT_HS_FINDER struct hs_finder_input* hs_finder_input_open_range (const char* filename, unsigned long long offset, unsigned long long length);
+
+/*! \brief get size of input file
+ * \param  input           hs_finder_input object
+ * \return size of file in bytes (or 0 if input is not a regular file)
+ * \sa     hs_finder_input_open()
+ */
+DLL_EXPORT_HS_FINDER unsigned long long hs_finder_input_get_size (struct hs_finder_input* input);
+
+/*! \brief get next chunk of input data
+ * \param  input           hs_finder_input object
+ * \param  datalen         pointer to variable receiving length of data
+ * \return data (or NULL at end of data or on error), valid until the next call to hs_finder_input_read() or hs_finder_input_close()
+ * \sa     hs_finder_input_open()
+ * \sa     hs_finder_process()
+ */
+DLL_EXPORT_HS_FINDER const char* hs_finder_input_read (struct hs_finder_input* input, size_t* datalen);
+
+/*! \brief skip input data
+ * \param  input           hs_finder_input object
+ * \param  length          number of bytes to skip
+ * \return number of bytes skipped (less than \p length if the end of the data was reached)
+ * \sa     hs_finder_input_read()
+ * \sa     hs_finder_load_checkpoint()
+ *
+ * Used to continue after the input processed before a checkpoint was saved.
+ * Uncompressed memory mapped files are skipped without reading them, other input (including compressed data) is read and discarded.
+ */
+DLL_EXPORT_HS_FINDER unsigned long long hs_finder_input_skip (struct hs_finder_input* input, unsigned long long length);
+
+/*! \brief close input file
+ * \param  input           hs_finder_input object
+ * \sa     hs_finder_input_open()
+ *
+ * When closed before all data was read, this waits for a read in progress by the read-ahead thread to finish.
+ */
+DLL_EXPORT_HS_FINDER void hs_finder_input_close (struct hs_finder_input* input);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //INCLUDED_HS_FINDER_INPUT_H
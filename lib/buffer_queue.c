@@ -0,0 +1,203 @@
+#include "buffer_queue.h"
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+struct buffer_queue_slot_struct {
+  char* data;
+  size_t datalen;
+};
+
+/* the producer fills slots[tail] in place and the consumer reads slots[head] in place,
+   filled is the number of slots passed to the consumer and not released yet
+*/
+struct buffer_queue_struct {
+  struct buffer_queue_slot_struct* slots;
+  size_t buffers;
+  size_t buffersize;
+  size_t head;
+  size_t tail;
+  size_t filled;
+  int producing;
+  int eof;
+  int cancelled;
+  pthread_mutex_t lock;
+  pthread_cond_t notempty;
+  pthread_cond_t notfull;
+};
+
+struct buffer_queue_struct* initialize_buffer_queue (size_t buffers, size_t buffersize)
+{
+  size_t i;
+  struct buffer_queue_struct* result;
+  if ((result = (struct buffer_queue_struct*)malloc(sizeof(struct buffer_queue_struct))) != NULL) {
+    if ((result->slots = (struct buffer_queue_slot_struct*)malloc(buffers * sizeof(struct buffer_queue_slot_struct))) == NULL) {
+      free(result);
+      return NULL;
+    }
+    for (i = 0; i < buffers; i++) {
+      if ((result->slots[i].data = (char*)malloc(buffersize)) == NULL) {
+        while (i-- > 0)
+          free(result->slots[i].data);
+        free(result->slots);
+        free(result);
+        return NULL;
+      }
+      result->slots[i].datalen = 0;
+    }
+    result->buffers = buffers;
+    result->buffersize = buffersize;
+    result->head = 0;
+    result->tail = 0;
+    result->filled = 0;
+    result->producing = 0;
+    result->eof = 0;
+    result->cancelled = 0;
+    pthread_mutex_init(&result->lock, NULL);
+    pthread_cond_init(&result->notempty, NULL);
+    pthread_cond_init(&result->notfull, NULL);
+  }
+  return result;
+}
+
+void deinitialize_buffer_queue (struct buffer_queue_struct* queue)
+{
+  size_t i;
+  if (queue) {
+    for (i = 0; i < queue->buffers; i++)
+      free(queue->slots[i].data);
+    free(queue->slots);
+    pthread_mutex_destroy(&queue->lock);
+    pthread_cond_destroy(&queue->notempty);
+    pthread_cond_destroy(&queue->notfull);
+    free(queue);
+  }
+}
+
+void reset_buffer_queue (struct buffer_queue_struct* queue)
+{
+  size_t i;
+  for (i = 0; i < queue->buffers; i++)
+    queue->slots[i].datalen = 0;
+  queue->head = 0;
+  queue->tail = 0;
+  queue->filled = 0;
+  queue->producing = 0;
+  queue->eof = 0;
+  queue->cancelled = 0;
+}
+
+static void buffer_queue_commit (struct buffer_queue_struct* queue, int eof)
+{
+  pthread_mutex_lock(&queue->lock);
+  if (queue->producing) {
+    queue->producing = 0;
+    queue->tail = (queue->tail + 1) % queue->buffers;
+    queue->filled++;
+  }
+  if (eof)
+    queue->eof = 1;
+  pthread_cond_signal(&queue->notempty);
+  pthread_mutex_unlock(&queue->lock);
+}
+
+size_t buffer_queue_write (struct buffer_queue_struct* queue, const char* data, size_t datalen)
+{
+  size_t len;
+  size_t result = datalen;
+  struct buffer_queue_slot_struct* slot;
+  while (datalen > 0) {
+    //wait for an empty buffer
+    if (!queue->producing) {
+      pthread_mutex_lock(&queue->lock);
+      while (queue->filled == queue->buffers)
+        pthread_cond_wait(&queue->notfull, &queue->lock);
+      pthread_mutex_unlock(&queue->lock);
+      queue->producing = 1;
+      queue->slots[queue->tail].datalen = 0;
+    }
+    //fill buffer and pass it on when full
+    slot = &queue->slots[queue->tail];
+    if ((len = queue->buffersize - slot->datalen) > datalen)
+      len = datalen;
+    memcpy(slot->data + slot->datalen, data, len);
+    slot->datalen += len;
+    data += len;
+    datalen -= len;
+    if (slot->datalen == queue->buffersize)
+      buffer_queue_commit(queue, 0);
+  }
+  return result;
+}
+
+void buffer_queue_flush (struct buffer_queue_struct* queue)
+{
+  if (queue->producing && queue->slots[queue->tail].datalen > 0)
+    buffer_queue_commit(queue, 0);
+}
+
+void buffer_queue_close (struct buffer_queue_struct* queue)
+{
+  if (queue->producing && queue->slots[queue->tail].datalen == 0)
+    queue->producing = 0;
+  buffer_queue_commit(queue, 1);
+}
+
+char* buffer_queue_get_write_buffer (struct buffer_queue_struct* queue, size_t* buffersize)
+{
+  if (!queue->producing) {
+    pthread_mutex_lock(&queue->lock);
+    while (queue->filled == queue->buffers && !queue->cancelled)
+      pthread_cond_wait(&queue->notfull, &queue->lock);
+    if (queue->cancelled) {
+      pthread_mutex_unlock(&queue->lock);
+      return NULL;
+    }
+    pthread_mutex_unlock(&queue->lock);
+    queue->producing = 1;
+    queue->slots[queue->tail].datalen = 0;
+  }
+  *buffersize = queue->buffersize;
+  return queue->slots[queue->tail].data;
+}
+
+void buffer_queue_commit_write (struct buffer_queue_struct* queue, size_t datalen)
+{
+  queue->slots[queue->tail].datalen = datalen;
+  if (datalen > 0)
+    buffer_queue_commit(queue, 0);
+}
+
+void buffer_queue_cancel (struct buffer_queue_struct* queue)
+{
+  pthread_mutex_lock(&queue->lock);
+  queue->cancelled = 1;
+  pthread_cond_broadcast(&queue->notfull);
+  pthread_mutex_unlock(&queue->lock);
+}
+
+const char* buffer_queue_read (struct buffer_queue_struct* queue, size_t* datalen)
+{
+  struct buffer_queue_slot_struct* slot;
+  pthread_mutex_lock(&queue->lock);
+  while (queue->filled == 0 && !queue->eof)
+    pthread_cond_wait(&queue->notempty, &queue->lock);
+  if (queue->filled == 0) {
+    pthread_mutex_unlock(&queue->lock);
+    *datalen = 0;
+    return NULL;
+  }
+  pthread_mutex_unlock(&queue->lock);
+  slot = &queue->slots[queue->head];
+  *datalen = slot->datalen;
+  return slot->data;
+}
+
+void buffer_queue_release (struct buffer_queue_struct* queue)
+{
+  pthread_mutex_lock(&queue->lock);
+  queue->head = (queue->head + 1) % queue->buffers;
+  queue->filled--;
+  pthread_cond_signal(&queue->notfull);
+  pthread_mutex_unlock(&queue->lock);
+}
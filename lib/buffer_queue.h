@@ -0,0 +1,52 @@
+#ifndef INCLUDED_BUFFER_QUEUE_H
+#define INCLUDED_BUFFER_QUEUE_H
+
+#include <stdlib.h>
+
+/* C library for passing data from one thread to another through a bounded queue of buffers (single producer, single consumer) */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//data structure
+struct buffer_queue_struct;
+
+//initialize
+struct buffer_queue_struct* initialize_buffer_queue (size_t buffers, size_t buffersize);
+
+//clean up
+void deinitialize_buffer_queue (struct buffer_queue_struct* queue);
+
+//reset (only when neither producer nor consumer is using the queue)
+void reset_buffer_queue (struct buffer_queue_struct* queue);
+
+//add data (producer, blocks while all buffers are in use)
+size_t buffer_queue_write (struct buffer_queue_struct* queue, const char* data, size_t datalen);
+
+//pass partially filled buffer to consumer (producer)
+void buffer_queue_flush (struct buffer_queue_struct* queue);
+
+//pass partially filled buffer to consumer and signal end of data (producer)
+void buffer_queue_close (struct buffer_queue_struct* queue);
+
+//get empty buffer to fill in place (producer, blocks while all buffers are in use, returns NULL if cancelled)
+char* buffer_queue_get_write_buffer (struct buffer_queue_struct* queue, size_t* buffersize);
+
+//pass buffer returned by buffer_queue_get_write_buffer() to consumer after filling datalen bytes (producer)
+void buffer_queue_commit_write (struct buffer_queue_struct* queue, size_t datalen);
+
+//make producer stop waiting for empty buffers when consumer doesn't need more data (consumer)
+void buffer_queue_cancel (struct buffer_queue_struct* queue);
+
+//get next buffer (consumer, blocks until data is available, returns NULL at end of data)
+const char* buffer_queue_read (struct buffer_queue_struct* queue, size_t* datalen);
+
+//give buffer returned by buffer_queue_read() back to producer (consumer)
+void buffer_queue_release (struct buffer_queue_struct* queue);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //INCLUDED_BUFFER_QUEUE_H
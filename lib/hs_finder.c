@@ -1,15 +1,84 @@
 #include "hs_finder.h"
 #include "search_data_buffer.h"
 #include "hyperscan_expr_list.h"
+#include "hyperscan_db_cache.h"
+#include "buffer_queue.h"
+#include "hyperscan_scratch_pool.h"
+#include "output_buffer.h"
 #include <stdlib.h>
 #include <string.h>
+#include <limits.h>
+#include <errno.h>
+#include <pthread.h>
+#ifdef _WIN32
+#include <io.h>
+#include <windows.h>
+#else
+#include <unistd.h>
+#include <time.h>
+#include <sys/uio.h>
+#endif
 
+//default maximum buffer size for search instances with expressions of unbounded width (0 for unlimited)
 #ifndef HS_MAX_BUFFER_SIZE
 #define HS_MAX_BUFFER_SIZE 1024
 #endif
-#if HS_MAX_BUFFER_SIZE == 0
-#undef HS_MAX_BUFFER_SIZE
+
+//number of buffers and size of each buffer passing data between threads in pipelined mode
+#ifndef HS_PIPELINE_BUFFERS
+#define HS_PIPELINE_BUFFERS 4
+#endif
+#ifndef HS_PIPELINE_BUFFER_SIZE
+#define HS_PIPELINE_BUFFER_SIZE 65536
+#endif
+
+//number of data segments passed to hs_scan_vector() without allocating memory
+#define HS_SCAN_VECTOR_STACK_SIZE 16
+
+//default size of output buffer when output is passed to a function of type hs_finder_outputv_fn
+#ifndef HS_OUTPUT_BUFFER_SIZE
+#define HS_OUTPUT_BUFFER_SIZE 65536
+#endif
+
+//maximum number of data segments written with one call to writev()
+#ifdef IOV_MAX
+#define HS_WRITEV_MAX_SEGMENTS (IOV_MAX < 64 ? IOV_MAX : 64)
+#else
+#define HS_WRITEV_MAX_SEGMENTS 64
+#endif
+
+//minimum number of candidate matches to allocate for replacing
+#define HS_REPLACEMENT_MIN_CANDIDATES 64
+
+//time one in this many calls to the match function for statistics when not profiling (power of 2)
+#ifndef HS_CALLBACK_SAMPLE_INTERVAL
+#define HS_CALLBACK_SAMPLE_INTERVAL 64
+#endif
+
+//flags supported by hs_compile_lit_multi() (other flags don't change how literal strings match)
+#define HS_LITERAL_FLAGS (HS_FLAG_CASELESS | HS_FLAG_SINGLEMATCH | HS_FLAG_SOM_LEFTMOST)
+
+//maximum number of streams of suspended search instances kept for reuse when resuming
+#ifndef HS_STREAM_POOL_SIZE
+#define HS_STREAM_POOL_SIZE 16
+#endif
+
+//get monotonic time in nanoseconds (for statistics)
+static unsigned long long hs_finder_get_time ()
+{
+#ifdef _WIN32
+  static LARGE_INTEGER frequency = {0};
+  LARGE_INTEGER counter;
+  if (frequency.QuadPart == 0)
+    QueryPerformanceFrequency(&frequency);
+  QueryPerformanceCounter(&counter);
+  return (unsigned long long)(counter.QuadPart / frequency.QuadPart) * 1000000000ULL + (unsigned long long)(counter.QuadPart % frequency.QuadPart) * 1000000000ULL / (unsigned long long)frequency.QuadPart;
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (unsigned long long)ts.tv_sec * 1000000000ULL + (unsigned long long)ts.tv_nsec;
 #endif
+}
 
 DLL_EXPORT_HS_FINDER void hs_finder_get_version (int* pmajor, int* pminor, int* pmicro)
 {
@@ -26,36 +95,283 @@ DLL_EXPORT_HS_FINDER const char* hs_finder_get_version_string ()
   return HS_FINDER_VERSION_STRING;
 }
 
+//compiled database and scratch space for one compile mode
+struct hs_finder_database {
+  hs_database_t* database;
+  struct hyperscan_scratch_pool_struct* scratchpool;
+  int fromcache;
+};
+
+//replacement for matches of an expression id
+struct hs_finder_replacement {
+  unsigned int id;
+  char* data;
+  size_t datalen;
+};
+
+/* compiled expressions of a search instance, shared by all streams created from it with hs_finder_create_stream()
+   (a pattern set is never modified while it is shared: hs_finder_add_expr() detaches it first)
+   databases are compiled on first use, block and vectored mode are only compiled if hs_finder_process_block() or hs_finder_process_block_iov() is used
+*/
+struct hs_finder_patterns {
+  struct hyperscan_expr_list_struct* hyperscanexprlist;
+  struct hs_finder_database stream;
+  struct hs_finder_database block;
+  struct hs_finder_database vectored;
+  unsigned int maxmatchwidth;
+  struct hs_finder_replacement* replacements;
+  size_t replacementcount;
+  int somhorizon;
+  hs_platform_info_t platform;
+  int useplatform;
+  int dirty;
+  size_t refcount;
+  hs_stream_t* streampool[HS_STREAM_POOL_SIZE];
+  size_t streampoolcount;
+  pthread_mutex_t lock;
+};
+
+static struct hs_finder_patterns* hs_finder_patterns_create ()
+{
+  struct hs_finder_patterns* result;
+  if ((result = (struct hs_finder_patterns*)malloc(sizeof(struct hs_finder_patterns))) != NULL) {
+    if ((result->hyperscanexprlist = initialize_hyperscan_data()) == NULL) {
+      free(result);
+      return NULL;
+    }
+    result->stream.database = NULL;
+    result->stream.scratchpool = NULL;
+    result->stream.fromcache = 0;
+    result->block.database = NULL;
+    result->block.scratchpool = NULL;
+    result->block.fromcache = 0;
+    result->vectored.database = NULL;
+    result->vectored.scratchpool = NULL;
+    result->vectored.fromcache = 0;
+    result->maxmatchwidth = UINT_MAX;
+    result->replacements = NULL;
+    result->replacementcount = 0;
+    result->somhorizon = HS_FINDER_SOM_HORIZON_SMALL;
+    memset(&result->platform, 0, sizeof(result->platform));
+    result->useplatform = 0;
+    result->dirty = 1;
+    result->refcount = 1;
+    result->streampoolcount = 0;
+    pthread_mutex_init(&result->lock, NULL);
+  }
+  return result;
+}
+
+static void hs_finder_free_database (struct hs_finder_database* db)
+{
+  if (db->scratchpool) {
+    deinitialize_hyperscan_scratch_pool(db->scratchpool);
+    db->scratchpool = NULL;
+  }
+  if (db->database) {
+    hs_free_database(db->database);
+    db->database = NULL;
+  }
+}
+
+static void hs_finder_patterns_free_databases (struct hs_finder_patterns* patterns)
+{
+  //streams kept for reuse can't be used with a different database
+  while (patterns->streampoolcount > 0)
+    hs_close_stream(patterns->streampool[--patterns->streampoolcount], NULL, NULL, NULL);
+  hs_finder_free_database(&patterns->stream);
+  hs_finder_free_database(&patterns->block);
+  hs_finder_free_database(&patterns->vectored);
+}
+
+static struct hs_finder_patterns* hs_finder_patterns_addref (struct hs_finder_patterns* patterns)
+{
+  pthread_mutex_lock(&patterns->lock);
+  patterns->refcount++;
+  pthread_mutex_unlock(&patterns->lock);
+  return patterns;
+}
+
+//check if patterns are used by more than one stream
+static int hs_finder_patterns_is_shared (struct hs_finder_patterns* patterns)
+{
+  int result;
+  pthread_mutex_lock(&patterns->lock);
+  result = (patterns->refcount > 1);
+  pthread_mutex_unlock(&patterns->lock);
+  return result;
+}
+
+static void hs_finder_patterns_release (struct hs_finder_patterns* patterns)
+{
+  size_t refcount;
+  if (!patterns)
+    return;
+  pthread_mutex_lock(&patterns->lock);
+  refcount = --patterns->refcount;
+  pthread_mutex_unlock(&patterns->lock);
+  if (refcount == 0) {
+    size_t i;
+    hs_finder_patterns_free_databases(patterns);
+    deinitialize_hyperscan_data(patterns->hyperscanexprlist);
+    for (i = 0; i < patterns->replacementcount; i++)
+      free(patterns->replacements[i].data);
+    free(patterns->replacements);
+    pthread_mutex_destroy(&patterns->lock);
+    free(patterns);
+  }
+}
+
+//find index of replacement for expression id (returns replacementcount if not found)
+static size_t hs_finder_patterns_find_replacement (struct hs_finder_patterns* patterns, unsigned int id)
+{
+  size_t lo = 0;
+  size_t hi = patterns->replacementcount;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (patterns->replacements[mid].id < id)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  if (lo < patterns->replacementcount && patterns->replacements[lo].id == id)
+    return lo;
+  return patterns->replacementcount;
+}
+
+//match found by expression with a replacement, kept until overlapping matches are resolved
+struct hs_finder_candidate {
+  unsigned long long from;
+  unsigned long long to;
+  unsigned int id;
+  size_t replacement;
+};
+
 struct hs_finder {
   struct search_data_buffer_struct* searchdatabuffer;
-  struct hyperscan_expr_list_struct* hyperscanexprlist;
+  struct hs_finder_patterns* patterns;
   match_event_handler matchfn;
   void* matchcallbackdata;
   search_data_buffer_output_fn* outputfn;
   void* outputcallbackdata;
-  hs_database_t* database;
-  hs_scratch_t* scratch;
+  size_t outputbuffersize;
+  struct output_buffer_struct* outputbuffer;
   hs_stream_t* stream;
+  char* suspendedstream;
+  size_t suspendedstreamlen;
+  char* cachedir;
+  size_t maxbuffersize;
+  int scanonly;
+  int pipeline;
+  int overlappolicy;
+  struct hs_finder_candidate* candidates;
+  size_t candidatecount;
+  size_t candidatealloc;
+  size_t* replacementcounts;
+  size_t replacementcountslen;
+  unsigned long long scanpos;
+  struct hs_finder_stats stats;
+  unsigned long long callbackcount;
+  unsigned long long sampledcallbacktime;
+  int profiling;
+  struct hs_finder_pattern_profile* profile;
+  size_t profilecount;
+  struct buffer_queue_struct* inputqueue;
+  pthread_t thread;
+  int threadrunning;
+  hs_error_t threadstatus;
   struct hs_finder* next;
   struct hs_finder* last;
 };
 
-DLL_EXPORT_HS_FINDER struct hs_finder* hs_finder_initialize (hs_finder_match_fn matchfn, void* callbackdata)
+static struct hs_finder* hs_finder_create_instance (match_event_handler matchfn, void* callbackdata, struct hs_finder_patterns* patterns)
 {
   struct hs_finder* result;
-  if ((result = (struct hs_finder*)malloc(sizeof(struct hs_finder))) != NULL) {
-    result->searchdatabuffer = initialize_search_data_buffer();
-    result->hyperscanexprlist = initialize_hyperscan_data();
-    result->matchfn = (match_event_handler)matchfn;
+  if (!patterns)
+    return NULL;
+  if ((result = (struct hs_finder*)malloc(sizeof(struct hs_finder))) == NULL) {
+    hs_finder_patterns_release(patterns);
+    return NULL;
+  }
+  if ((result->searchdatabuffer = initialize_search_data_buffer()) != NULL) {
+    result->patterns = patterns;
+    result->matchfn = matchfn;
     result->matchcallbackdata = callbackdata;
     result->outputfn = NULL;
     result->outputcallbackdata = NULL;
-    result->database = NULL;
-    result->scratch = NULL;
+    result->outputbuffersize = 0;
+    result->outputbuffer = NULL;
     result->stream = NULL;
+    result->suspendedstream = NULL;
+    result->suspendedstreamlen = 0;
+    result->cachedir = NULL;
+    result->maxbuffersize = HS_MAX_BUFFER_SIZE;
+    result->scanonly = 0;
+    result->pipeline = 0;
+    result->overlappolicy = HS_FINDER_OVERLAP_LEFTMOST_LONGEST;
+    result->candidates = NULL;
+    result->candidatecount = 0;
+    result->candidatealloc = 0;
+    result->replacementcounts = NULL;
+    result->replacementcountslen = 0;
+    result->scanpos = 0;
+    memset(&result->stats, 0, sizeof(result->stats));
+    result->callbackcount = 0;
+    result->sampledcallbacktime = 0;
+    result->profiling = 0;
+    result->profile = NULL;
+    result->profilecount = 0;
+    result->inputqueue = NULL;
+    result->threadrunning = 0;
+    result->threadstatus = HS_SUCCESS;
     result->next = NULL;
     result->last = result;
+  } else {
+    hs_finder_patterns_release(patterns);
+    free(result);
+    result = NULL;
+  }
+  return result;
+}
+
+DLL_EXPORT_HS_FINDER struct hs_finder* hs_finder_initialize (hs_finder_match_fn matchfn, void* callbackdata)
+{
+  return hs_finder_create_instance((match_event_handler)matchfn, callbackdata, hs_finder_patterns_create());
+}
+
+DLL_EXPORT_HS_FINDER struct hs_finder* hs_finder_create_stream (struct hs_finder* finder, void* callbackdata)
+{
+  struct hs_finder* result = NULL;
+  struct hs_finder* last = NULL;
+  struct hs_finder* current;
+  struct hs_finder* instance;
+  //all search instances must have been compiled
+  for (current = finder; current; current = current->next) {
+    if (current->patterns->dirty) {
+      fprintf(stderr, "ERROR: Unable to create stream from search instance that was not opened\n");
+      return NULL;
+    }
+  }
+  //create search instances sharing the compiled expressions
+  for (current = finder; current; current = current->next) {
+    if ((instance = hs_finder_create_instance(current->matchfn, (callbackdata ? callbackdata : current->matchcallbackdata), hs_finder_patterns_addref(current->patterns))) == NULL) {
+      hs_finder_cleanup(result);
+      return NULL;
+    }
+    if (current->cachedir)
+      instance->cachedir = strdup(current->cachedir);
+    instance->maxbuffersize = current->maxbuffersize;
+    instance->pipeline = current->pipeline;
+    instance->overlappolicy = current->overlappolicy;
+    instance->outputbuffersize = current->outputbuffersize;
+    instance->profiling = current->profiling;
+    if (last)
+      last->next = instance;
+    else
+      result = instance;
+    last = instance;
   }
+  result->last = last;
   return result;
 }
 
@@ -68,170 +384,2048 @@ DLL_EXPORT_HS_FINDER void hs_finder_cleanup (struct hs_finder* finder)
     next = current->next;
     if (current->searchdatabuffer)
       deinitialize_search_data_buffer(current->searchdatabuffer);
-    if (current->hyperscanexprlist)
-      deinitialize_hyperscan_data(current->hyperscanexprlist);
-    if (current->scratch)
-      hs_free_scratch(current->scratch);
-    if (current->database)
-      hs_free_database(current->database);
+    if (current->stream)
+      hs_close_stream(current->stream, NULL, NULL, NULL);
+    free(current->suspendedstream);
+    hs_finder_patterns_release(current->patterns);
+    if (current->cachedir)
+      free(current->cachedir);
+    if (current->inputqueue)
+      deinitialize_buffer_queue(current->inputqueue);
+    free(current->candidates);
+    free(current->replacementcounts);
+    free(current->profile);
+    deinitialize_output_buffer(current->outputbuffer);
     free(current);
     current = next;
   }
 }
 
+//don't modify expressions shared with other streams, make a private copy instead (returns non-zero on error)
+static int hs_finder_detach_patterns (struct hs_finder* instance)
+{
+  size_t i;
+  char* literal;
+  struct hs_finder_patterns* patterns;
+  struct hyperscan_expr_list_struct* exprlist = instance->patterns->hyperscanexprlist;
+  const size_t* lengths = hyperscan_expr_list_get_lengths(exprlist);
+  if (!hs_finder_patterns_is_shared(instance->patterns))
+    return 0;
+  if ((patterns = hs_finder_patterns_create()) == NULL)
+    return 1;
+  //a copy missing any of the expressions or replacements would search for something else, so fail on any allocation error
+  for (i = 0; i < hyperscan_expr_list_count(exprlist); i++) {
+    if (lengths[i] == 0) {
+      hyperscan_expr_list_add(patterns->hyperscanexprlist, strdup(hyperscan_expr_list_get_expressions(exprlist)[i]), hyperscan_expr_list_get_flags(exprlist)[i], hyperscan_expr_list_get_ids(exprlist)[i]);
+    } else if ((literal = (char*)malloc(lengths[i])) != NULL) {
+      memcpy(literal, hyperscan_expr_list_get_literals(exprlist)[i], lengths[i]);
+      hyperscan_expr_list_add_literal(patterns->hyperscanexprlist, literal, lengths[i], hyperscan_expr_list_get_flags(exprlist)[i], hyperscan_expr_list_get_ids(exprlist)[i]);
+    }
+    if (hyperscan_expr_list_count(patterns->hyperscanexprlist) != i + 1) {
+      hs_finder_patterns_release(patterns);
+      return 1;
+    }
+  }
+  if (instance->patterns->replacementcount > 0) {
+    if ((patterns->replacements = (struct hs_finder_replacement*)malloc(instance->patterns->replacementcount * sizeof(struct hs_finder_replacement))) == NULL) {
+      hs_finder_patterns_release(patterns);
+      return 1;
+    }
+    for (i = 0; i < instance->patterns->replacementcount; i++) {
+      if ((patterns->replacements[i].data = (char*)malloc(instance->patterns->replacements[i].datalen + 1)) == NULL) {
+        hs_finder_patterns_release(patterns);
+        return 1;
+      }
+      memcpy(patterns->replacements[i].data, instance->patterns->replacements[i].data, instance->patterns->replacements[i].datalen + 1);
+      patterns->replacements[i].id = instance->patterns->replacements[i].id;
+      patterns->replacements[i].datalen = instance->patterns->replacements[i].datalen;
+      patterns->replacementcount++;
+    }
+  }
+  patterns->somhorizon = instance->patterns->somhorizon;
+  patterns->platform = instance->patterns->platform;
+  patterns->useplatform = instance->patterns->useplatform;
+  if (instance->stream) {
+    hs_close_stream(instance->stream, NULL, NULL, NULL);
+    instance->stream = NULL;
+  }
+  hs_finder_patterns_release(instance->patterns);
+  instance->patterns = patterns;
+  return 0;
+}
+
 DLL_EXPORT_HS_FINDER void hs_finder_add_expr (struct hs_finder* finder, const char* expr, unsigned int flags, unsigned int id)
 {
-  if (expr)
-    hyperscan_expr_list_add(finder->last->hyperscanexprlist, strdup(expr), flags, id);
+  struct hs_finder* last = finder->last;
+  if (expr) {
+    if (hs_finder_detach_patterns(last) != 0)
+      return;
+    hyperscan_expr_list_add(last->patterns->hyperscanexprlist, strdup(expr), flags, id);
+    last->patterns->dirty = 1;
+  }
+}
+
+DLL_EXPORT_HS_FINDER void hs_finder_add_literal (struct hs_finder* finder, const char* literal, size_t literallen, unsigned int flags, unsigned int id)
+{
+  char* data;
+  struct hs_finder* last = finder->last;
+  //an empty string would match everywhere
+  if (literal && literallen > 0) {
+    if (hs_finder_detach_patterns(last) != 0)
+      return;
+    if ((data = (char*)malloc(literallen)) == NULL)
+      return;
+    memcpy(data, literal, literallen);
+    hyperscan_expr_list_add_literal(last->patterns->hyperscanexprlist, data, literallen, flags & HS_LITERAL_FLAGS, id);
+    last->patterns->dirty = 1;
+  }
+}
+
+DLL_EXPORT_HS_FINDER int hs_finder_set_replacement (struct hs_finder* finder, unsigned int id, const char* replacement, size_t replacementlen)
+{
+  size_t i;
+  char* data;
+  struct hs_finder_patterns* patterns;
+  if (!replacement && replacementlen > 0)
+    return -1;
+  if (hs_finder_detach_patterns(finder->last) != 0)
+    return -1;
+  patterns = finder->last->patterns;
+  //keep a copy with terminating zero
+  if ((data = (char*)malloc(replacementlen + 1)) == NULL)
+    return -1;
+  if (replacementlen > 0)
+    memcpy(data, replacement, replacementlen);
+  data[replacementlen] = 0;
+  //replace existing replacement for the same id or insert new one keeping the list sorted by id
+  if ((i = hs_finder_patterns_find_replacement(patterns, id)) < patterns->replacementcount) {
+    free(patterns->replacements[i].data);
+  } else {
+    struct hs_finder_replacement* newreplacements;
+    if ((newreplacements = (struct hs_finder_replacement*)realloc(patterns->replacements, (patterns->replacementcount + 1) * sizeof(struct hs_finder_replacement))) == NULL) {
+      free(data);
+      return -1;
+    }
+    patterns->replacements = newreplacements;
+    for (i = patterns->replacementcount; i > 0 && patterns->replacements[i - 1].id > id; i--)
+      patterns->replacements[i] = patterns->replacements[i - 1];
+    patterns->replacementcount++;
+  }
+  patterns->replacements[i].id = id;
+  patterns->replacements[i].data = data;
+  patterns->replacements[i].datalen = replacementlen;
+  return 0;
 }
 
 DLL_EXPORT_HS_FINDER void hs_finder_add_instance (struct hs_finder* finder, hs_finder_match_fn matchfn, void* callbackdata)
 {
-  if (hyperscan_expr_list_count(finder->last->hyperscanexprlist) > 0) {
+  if (hyperscan_expr_list_count(finder->last->patterns->hyperscanexprlist) > 0) {
     finder->last->next = hs_finder_initialize(matchfn, callbackdata);
+    if (finder->last->next) {
+      if (finder->last->cachedir)
+        finder->last->next->cachedir = strdup(finder->last->cachedir);
+      finder->last->next->maxbuffersize = finder->last->maxbuffersize;
+      finder->last->next->pipeline = finder->last->pipeline;
+      finder->last->next->overlappolicy = finder->last->overlappolicy;
+      finder->last->next->outputbuffersize = finder->last->outputbuffersize;
+      finder->last->next->profiling = finder->last->profiling;
+      finder->last->next->patterns->somhorizon = finder->last->patterns->somhorizon;
+      finder->last->next->patterns->platform = finder->last->patterns->platform;
+      finder->last->next->patterns->useplatform = finder->last->patterns->useplatform;
+    }
     finder->last = finder->last->next;
   }
 }
 
-DLL_EXPORT_HS_FINDER size_t hs_finder_output_to_stream (void* callbackdata, const char* data, size_t datalen)
+DLL_EXPORT_HS_FINDER void hs_finder_set_som_horizon (struct hs_finder* finder, int horizon)
 {
-  return fwrite(data, 1, datalen, (FILE*)callbackdata);
+  struct hs_finder* last = finder->last;
+  if (horizon != HS_FINDER_SOM_NONE && horizon != HS_FINDER_SOM_HORIZON_SMALL && horizon != HS_FINDER_SOM_HORIZON_MEDIUM && horizon != HS_FINDER_SOM_HORIZON_LARGE)
+    return;
+  if (last->patterns->somhorizon == horizon)
+    return;
+  if (hs_finder_detach_patterns(last) != 0)
+    return;
+  last->patterns->somhorizon = horizon;
+  last->patterns->dirty = 1;
 }
 
-DLL_EXPORT_HS_FINDER size_t hs_finder_output_to_null (void* callbackdata, const char* data, size_t datalen)
+DLL_EXPORT_HS_FINDER void hs_finder_set_platform (struct hs_finder* finder, const hs_platform_info_t* platform)
 {
-  return datalen;
+  struct hs_finder* last = finder->last;
+  if (!platform && !last->patterns->useplatform)
+    return;
+  if (platform && last->patterns->useplatform && platform->tune == last->patterns->platform.tune && platform->cpu_features == last->patterns->platform.cpu_features)
+    return;
+  if (hs_finder_detach_patterns(last) != 0)
+    return;
+  if (platform) {
+    last->patterns->platform = *platform;
+    last->patterns->useplatform = 1;
+  } else {
+    memset(&last->patterns->platform, 0, sizeof(last->patterns->platform));
+    last->patterns->useplatform = 0;
+  }
+  last->patterns->dirty = 1;
 }
 
-DLL_EXPORT_HS_FINDER hs_error_t hs_finder_open (struct hs_finder* finder, search_data_buffer_output_fn outputfn, void* callbackdata)
+DLL_EXPORT_HS_FINDER void hs_finder_set_cache_dir (struct hs_finder* finder, const char* path)
 {
-  hs_error_t status;
-  hs_compile_error_t *compile_err;
   struct hs_finder* current = finder;
-  //delete last instance if expression list is empty
-  if (hyperscan_expr_list_count(finder->last->hyperscanexprlist) == 0) {
-    struct hs_finder* current;
-    current = finder;
-    while (current) {
-      if (current->next == finder->last)
-        break;
-      current = current->next;
-    }
-    if (current) {
-      hs_finder_cleanup(finder->last);
-      current->next = NULL;
-      finder->last = current;
-    }
+  while (current) {
+    if (current->cachedir)
+      free(current->cachedir);
+    current->cachedir = (path ? strdup(path) : NULL);
+    current = current->next;
   }
+}
+
+DLL_EXPORT_HS_FINDER void hs_finder_set_max_buffer_size (struct hs_finder* finder, size_t maxbuffersize)
+{
+  struct hs_finder* current = finder;
   while (current) {
-    //set output function (daisy chain with next if not last in chain, otherwise set final output function)
-    if (current->next) {
-      current->outputfn = (hs_finder_output_fn)hs_finder_process;
-      current->outputcallbackdata = current->next;
-    } else {
-      current->outputfn = (search_data_buffer_output_fn*)(outputfn ? outputfn : hs_finder_output_to_stream);
-      current->outputcallbackdata = callbackdata;
+    current->maxbuffersize = maxbuffersize;
+    current = current->next;
+  }
+}
+
+DLL_EXPORT_HS_FINDER void hs_finder_set_pipeline (struct hs_finder* finder, int pipeline)
+{
+  struct hs_finder* current = finder;
+  while (current) {
+    current->pipeline = pipeline;
+    current = current->next;
+  }
+}
+
+DLL_EXPORT_HS_FINDER void hs_finder_set_output_buffer_size (struct hs_finder* finder, size_t outputbuffersize)
+{
+  struct hs_finder* current = finder;
+  while (current) {
+    current->outputbuffersize = outputbuffersize;
+    current = current->next;
+  }
+}
+
+DLL_EXPORT_HS_FINDER void hs_finder_set_overlap_policy (struct hs_finder* finder, int policy)
+{
+  struct hs_finder* current = finder;
+  while (current) {
+    current->overlappolicy = policy;
+    current = current->next;
+  }
+}
+
+DLL_EXPORT_HS_FINDER void hs_finder_set_profiling (struct hs_finder* finder, int profiling)
+{
+  struct hs_finder* current = finder;
+  while (current) {
+    current->profiling = profiling;
+    current = current->next;
+  }
+}
+
+DLL_EXPORT_HS_FINDER size_t hs_finder_get_replacement_count (struct hs_finder* finder, unsigned int id)
+{
+  size_t i;
+  struct hs_finder* current;
+  size_t result = 0;
+  for (current = finder; current; current = current->next) {
+    if ((i = hs_finder_patterns_find_replacement(current->patterns, id)) < current->replacementcountslen)
+      result += current->replacementcounts[i];
+  }
+  return result;
+}
+
+static unsigned int hs_finder_calculate_max_match_width (struct hyperscan_expr_list_struct* exprlist)
+{
+  size_t i;
+  hs_expr_info_t* info;
+  hs_compile_error_t *compile_err;
+  unsigned int result = 0;
+  size_t n = hyperscan_expr_list_count(exprlist);
+  const char* const* expressions = hyperscan_expr_list_get_expressions(exprlist);
+  const unsigned int* flags = hyperscan_expr_list_get_flags(exprlist);
+  const size_t* lengths = hyperscan_expr_list_get_lengths(exprlist);
+  for (i = 0; i < n && result != UINT_MAX; i++) {
+    //literal strings always match their own length
+    if (lengths[i] > 0) {
+      if (lengths[i] > result)
+        result = (lengths[i] < UINT_MAX ? (unsigned int)lengths[i] : UINT_MAX);
+      continue;
     }
-    //reset output buffer
-    reset_search_data_buffer(current->searchdatabuffer);
-    //compile expressions
-    if ((status = hs_compile_multi(hyperscan_expr_list_get_expressions(current->hyperscanexprlist), hyperscan_expr_list_get_flags(current->hyperscanexprlist), hyperscan_expr_list_get_ids(current->hyperscanexprlist), hyperscan_expr_list_count(current->hyperscanexprlist), HS_MODE_STREAM | HS_MODE_SOM_HORIZON_SMALL, NULL, &current->database, &compile_err)) != HS_SUCCESS) {
-      fprintf(stderr, "ERROR: Unable to compile patterns: %s\n", compile_err->message);
+    if (hs_expression_info(expressions[i], flags[i], &info, &compile_err) != HS_SUCCESS) {
       hs_free_compile_error(compile_err);
+      return UINT_MAX;
     }
-    //allocate scratch space (can be reused for multiple calls to hs_scan)
-    if (status == HS_SUCCESS && current->scratch == NULL) {
-      /*current->scratch = NULL;*/
-      if ((status = hs_alloc_scratch(current->database, &current->scratch)) != HS_SUCCESS) {
-        fprintf(stderr, "ERROR: Unable to allocate scratch space. Exiting.\n");
-        hs_free_database(current->database);
-        current->database = NULL;
+    if (info->max_width > result)
+      result = info->max_width;
+    free(info);
+  }
+  return result;
+}
+
+DLL_EXPORT_HS_FINDER size_t hs_finder_get_split_overlap (struct hs_finder* finder)
+{
+  size_t i;
+  size_t n;
+  const char* const* expressions;
+  const unsigned int* flags;
+  const size_t* lengths;
+  hs_expr_info_t* info;
+  hs_compile_error_t *compile_err;
+  struct hs_finder* current;
+  size_t result = 0;
+  for (current = finder; current; current = current->next) {
+    n = hyperscan_expr_list_count(current->patterns->hyperscanexprlist);
+    expressions = hyperscan_expr_list_get_expressions(current->patterns->hyperscanexprlist);
+    flags = hyperscan_expr_list_get_flags(current->patterns->hyperscanexprlist);
+    lengths = hyperscan_expr_list_get_lengths(current->patterns->hyperscanexprlist);
+    for (i = 0; i < n; i++) {
+      if (lengths[i] > 0) {
+        if (lengths[i] > result)
+          result = lengths[i];
+        continue;
       }
-    }
-    //open stream
-    if (status == HS_SUCCESS) {
-      if ((status = hs_open_stream(current->database, HS_FLAG_SOM_LEFTMOST | HS_FLAG_DOTALL, &current->stream)) != HS_SUCCESS) {
-        fprintf(stderr, "ERROR %i: Unable to open scan input stream. Exiting.\n", (int)status);
-        hs_free_scratch(current->scratch);
-        current->scratch = NULL;
-        hs_free_database(current->database);
-        current->database = NULL;
+      if (hs_expression_info(expressions[i], flags[i], &info, &compile_err) != HS_SUCCESS) {
+        hs_free_compile_error(compile_err);
+        return HS_FINDER_NO_SPLIT;
       }
+      //matches of unlimited width or at the end of data can't be found in parts of the data
+      if (info->max_width == UINT_MAX || info->matches_at_eod || info->matches_only_at_eod) {
+        free(info);
+        return HS_FINDER_NO_SPLIT;
+      }
+      if (info->max_width > result)
+        result = info->max_width;
+      free(info);
     }
-    current = current->next;
   }
-  return status;
+  return result;
 }
 
-DLL_EXPORT_HS_FINDER hs_error_t hs_finder_process (struct hs_finder* finder, const char* data, size_t datalen)
+//get compile mode with start of match horizon (only used in stream mode)
+static unsigned int hs_finder_get_compile_mode (struct hs_finder_patterns* patterns, unsigned int mode)
+{
+  if (mode & HS_MODE_STREAM) {
+    switch (patterns->somhorizon) {
+      case HS_FINDER_SOM_HORIZON_SMALL :
+        return mode | HS_MODE_SOM_HORIZON_SMALL;
+      case HS_FINDER_SOM_HORIZON_MEDIUM :
+        return mode | HS_MODE_SOM_HORIZON_MEDIUM;
+      case HS_FINDER_SOM_HORIZON_LARGE :
+        return mode | HS_MODE_SOM_HORIZON_LARGE;
+    }
+  }
+  return mode;
+}
+
+//get mask for flags of expressions (without start of match flag if start of match is not needed)
+static unsigned int hs_finder_get_flags_mask (struct hs_finder_patterns* patterns)
+{
+  return (patterns->somhorizon == HS_FINDER_SOM_NONE ? ~(unsigned int)HS_FLAG_SOM_LEFTMOST : ~0U);
+}
+
+//get target platform (NULL for the current host)
+static const hs_platform_info_t* hs_finder_get_platform (struct hs_finder_patterns* patterns)
+{
+  return (patterns->useplatform ? &patterns->platform : NULL);
+}
+
+//compile expressions (or load them from cache if loadcache is non-zero, fromcache is set to indicate where the database came from)
+static hs_error_t hs_finder_compile (struct hs_finder* finder, unsigned int mode, int loadcache, hs_database_t** database, unsigned int* maxmatchwidth, int* fromcache)
 {
+  size_t i;
   hs_error_t status;
-  size_t buflen;
-  if (datalen == 0)
-    return HS_SUCCESS;
-#ifdef HS_MAX_BUFFER_SIZE
-  //flush buffer in case it gets too large
-  if ((buflen = search_data_buffer_get_len(finder->searchdatabuffer)) + datalen > HS_MAX_BUFFER_SIZE)
-    search_data_buffer_flush_fn(finder->searchdatabuffer, search_data_buffer_get_pos(finder->searchdatabuffer) + buflen + datalen - HS_MAX_BUFFER_SIZE, finder->outputfn, finder->outputcallbackdata);
-#endif
-  //add new data to buffer
-  search_data_buffer_add(finder->searchdatabuffer, data, datalen);
-  //scan new data
-  if ((status = hs_scan_stream(finder->stream, data, datalen, 0, finder->scratch, finder->matchfn, finder)) != HS_SUCCESS) {
-    fprintf(stderr, "ERROR %i in hs_scan_stream()\n", (int)status);
+  hs_compile_error_t *compile_err;
+  unsigned long long cachekey = 0;
+  struct hs_finder_patterns* patterns = finder->patterns;
+  size_t count = hyperscan_expr_list_count(patterns->hyperscanexprlist);
+  unsigned int flagsmask = hs_finder_get_flags_mask(patterns);
+  const unsigned int* flags = hyperscan_expr_list_get_flags(patterns->hyperscanexprlist);
+  unsigned int* maskedflags = NULL;
+  *database = NULL;
+  *fromcache = 0;
+  mode = hs_finder_get_compile_mode(patterns, mode);
+  //replacements need the start of matches
+  if (flagsmask != ~0U && patterns->replacementcount > 0) {
+    fprintf(stderr, "ERROR: Unable to compile patterns with replacements without start of match\n");
+    return HS_COMPILER_ERROR;
   }
-  return status;
+  //try to load compiled expressions from cache
+  if (finder->cachedir) {
+    cachekey = hyperscan_db_cache_key(patterns->hyperscanexprlist, mode, hs_finder_get_platform(patterns), flagsmask);
+    if (loadcache && (*database = hyperscan_db_cache_load(finder->cachedir, cachekey, maxmatchwidth)) != NULL) {
+      *fromcache = 1;
+      return HS_SUCCESS;
+    }
+  }
+  //remove flags that are not needed
+  if (flagsmask != ~0U) {
+    if ((maskedflags = (unsigned int*)malloc((count > 0 ? count : 1) * sizeof(unsigned int))) == NULL)
+      return HS_NOMEM;
+    for (i = 0; i < count; i++)
+      maskedflags[i] = flags[i] & flagsmask;
+    flags = maskedflags;
+  }
+  //compile expressions (with the faster literal compiler if there are only literal strings, otherwise literal strings are compiled as escaped regular expressions)
+  if (hyperscan_expr_list_count_literals(patterns->hyperscanexprlist) == count)
+    status = hs_compile_lit_multi(hyperscan_expr_list_get_literals(patterns->hyperscanexprlist), flags, hyperscan_expr_list_get_ids(patterns->hyperscanexprlist), hyperscan_expr_list_get_lengths(patterns->hyperscanexprlist), count, mode, hs_finder_get_platform(patterns), database, &compile_err);
+  else
+    status = hs_compile_multi(hyperscan_expr_list_get_expressions(patterns->hyperscanexprlist), flags, hyperscan_expr_list_get_ids(patterns->hyperscanexprlist), count, mode, hs_finder_get_platform(patterns), database, &compile_err);
+  free(maskedflags);
+  if (status != HS_SUCCESS) {
+    fprintf(stderr, "ERROR: Unable to compile patterns: %s\n", compile_err->message);
+    hs_free_compile_error(compile_err);
+    *database = NULL;
+    return status;
+  }
+  //determine how many bytes a match can span
+  *maxmatchwidth = hs_finder_calculate_max_match_width(patterns->hyperscanexprlist);
+  //store compiled expressions in cache
+  if (finder->cachedir) {
+    if (hyperscan_db_cache_save(finder->cachedir, cachekey, *database, *maxmatchwidth) != 0)
+      fprintf(stderr, "WARNING: Unable to save compiled patterns in cache directory: %s\n", finder->cachedir);
+  }
+  return HS_SUCCESS;
 }
 
-DLL_EXPORT_HS_FINDER hs_error_t hs_finder_close (struct hs_finder* finder)
+//make sure database for compile mode is available (compiled on first use, can be called from threads sharing the expressions)
+static hs_error_t hs_finder_compile_database (struct hs_finder* finder, unsigned int mode, struct hs_finder_database* db)
 {
   hs_error_t status = HS_SUCCESS;
-  struct hs_finder* current = finder;
-  while (current) {
-    search_data_buffer_flush_remaining_fn(current->searchdatabuffer, current->outputfn, current->outputcallbackdata);
-    if ((status = hs_close_stream(current->stream, current->scratch, current->matchfn, finder)) != HS_SUCCESS) {
-      fprintf(stderr, "ERROR %i in hs_close_stream()\n", (int)status);
-    }
-    if (current->scratch) {
-      hs_free_scratch(current->scratch);
-      current->scratch = NULL;
+  unsigned int maxmatchwidth;
+  struct hs_finder_patterns* patterns = finder->patterns;
+  pthread_mutex_lock(&patterns->lock);
+  //discard databases compiled before expressions were added
+  if (patterns->dirty) {
+    hs_finder_patterns_free_databases(patterns);
+    patterns->dirty = 0;
+  }
+  if (!db->database) {
+    //compile expressions (or load them from cache)
+    status = hs_finder_compile(finder, mode, 1, &db->database, &maxmatchwidth, &db->fromcache);
+    //the maximum match width doesn't depend on the compile mode, only set it with the first database
+    if (status == HS_SUCCESS && (patterns->stream.database ? 1 : 0) + (patterns->block.database ? 1 : 0) + (patterns->vectored.database ? 1 : 0) == 1)
+      patterns->maxmatchwidth = maxmatchwidth;
+  }
+  pthread_mutex_unlock(&patterns->lock);
+  return status;
+}
+
+//make sure database for compile mode and scratch space for it are available (compiled on first use, can be called from threads sharing the expressions)
+static hs_error_t hs_finder_prepare_database (struct hs_finder* finder, unsigned int mode, struct hs_finder_database* db)
+{
+  hs_error_t status;
+  struct hs_finder_patterns* patterns = finder->patterns;
+  if ((status = hs_finder_compile_database(finder, mode, db)) != HS_SUCCESS)
+    return status;
+  pthread_mutex_lock(&patterns->lock);
+  if (!db->scratchpool) {
+    //allocate scratch space (shared by all streams using the database, cloned for each thread scanning at the same time)
+    db->scratchpool = initialize_hyperscan_scratch_pool(db->database);
+    //a cached database may not be usable on this host, compile it again in that case
+    if (!db->scratchpool && db->fromcache) {
+      unsigned int maxmatchwidth;
+      fprintf(stderr, "WARNING: Unable to use cached database, compiling patterns again\n");
+      hs_free_database(db->database);
+      if ((status = hs_finder_compile(finder, mode, 0, &db->database, &maxmatchwidth, &db->fromcache)) == HS_SUCCESS)
+        db->scratchpool = initialize_hyperscan_scratch_pool(db->database);
     }
-    if (current->database) {
-      hs_free_database(current->database);
-      current->database = NULL;
+    if (status == HS_SUCCESS && !db->scratchpool) {
+      fprintf(stderr, "ERROR: Unable to allocate scratch space. Exiting.\n");
+      hs_free_database(db->database);
+      db->database = NULL;
+      status = HS_NOMEM;
     }
-    current = current->next;
   }
+  pthread_mutex_unlock(&patterns->lock);
   return status;
 }
 
-DLL_EXPORT_HS_FINDER size_t hs_finder_get_pos (struct hs_finder* finder)
+//get database of search instance for compile mode
+static struct hs_finder_database* hs_finder_get_database (struct hs_finder* finder, unsigned int mode)
 {
-  return search_data_buffer_get_pos(finder->searchdatabuffer);
+  if (mode & HS_MODE_VECTORED)
+    return &finder->patterns->vectored;
+  if (mode & HS_MODE_BLOCK)
+    return &finder->patterns->block;
+  return &finder->patterns->stream;
 }
 
-DLL_EXPORT_HS_FINDER const char* hs_finder_get_buf_at_pos (struct hs_finder* finder, size_t pos)
+//search instance compiled in its own thread
+struct hs_finder_compile_job {
+  pthread_t thread;
+  int threadrunning;
+  struct hs_finder* finder;
+  size_t index;
+  unsigned int mode;
+  hs_error_t status;
+};
+
+static void* hs_finder_compile_thread (void* param)
 {
-  return search_data_buffer_get_at_pos(finder->searchdatabuffer, pos);
+  struct hs_finder_compile_job* job = (struct hs_finder_compile_job*)param;
+  job->status = hs_finder_compile_database(job->finder, job->mode, hs_finder_get_database(job->finder, job->mode));
+  return NULL;
 }
 
-DLL_EXPORT_HS_FINDER void* hs_finder_get_callbackdata (struct hs_finder* finder)
+//check if expressions of search instance need to be compiled for compile mode
+static int hs_finder_needs_compile (struct hs_finder* finder, unsigned int mode)
 {
-  return finder->matchcallbackdata;
+  int result;
+  pthread_mutex_lock(&finder->patterns->lock);
+  result = (finder->patterns->dirty || !hs_finder_get_database(finder, mode)->database);
+  pthread_mutex_unlock(&finder->patterns->lock);
+  return result;
 }
 
-DLL_EXPORT_HS_FINDER size_t hs_finder_flush (struct hs_finder* finder, size_t flushpos)
+//compile expressions of all search instances that need it at the same time (each in its own thread, the last one in the calling thread), then allocate scratch space
+static hs_error_t hs_finder_prepare_databases (struct hs_finder* finder, unsigned int mode)
+{
+  size_t i;
+  size_t index;
+  size_t count;
+  struct hs_finder* current;
+  struct hs_finder_compile_job* jobs;
+  hs_error_t status = HS_SUCCESS;
+  //close streams that can't be used with the expressions that were added and count search instances to compile
+  count = 0;
+  for (current = finder; current; current = current->next) {
+    if (current->patterns->dirty && current->stream) {
+      hs_close_stream(current->stream, NULL, NULL, NULL);
+      current->stream = NULL;
+    }
+    if (hs_finder_needs_compile(current, mode))
+      count++;
+  }
+  //compile in parallel if more than one search instance needs it (otherwise or if memory for the jobs can't be allocated this is done below)
+  if (count > 1 && (jobs = (struct hs_finder_compile_job*)malloc(count * sizeof(struct hs_finder_compile_job))) != NULL) {
+    i = 0;
+    index = 0;
+    for (current = finder; current && i < count; current = current->next) {
+      index++;
+      if (!hs_finder_needs_compile(current, mode))
+        continue;
+      jobs[i].threadrunning = 0;
+      jobs[i].finder = current;
+      jobs[i].index = index;
+      jobs[i].mode = mode;
+      jobs[i].status = HS_SUCCESS;
+      if (i + 1 < count && pthread_create(&jobs[i].thread, NULL, hs_finder_compile_thread, &jobs[i]) == 0)
+        jobs[i].threadrunning = 1;
+      else
+        hs_finder_compile_thread(&jobs[i]);
+      i++;
+    }
+    count = i;
+    for (i = 0; i < count; i++) {
+      if (jobs[i].threadrunning)
+        pthread_join(jobs[i].thread, NULL);
+      if (jobs[i].status != HS_SUCCESS) {
+        fprintf(stderr, "ERROR %i: Unable to compile patterns of search instance %lu\n", (int)jobs[i].status, (unsigned long)jobs[i].index);
+        if (status == HS_SUCCESS)
+          status = jobs[i].status;
+      }
+    }
+    free(jobs);
+    if (status != HS_SUCCESS)
+      return status;
+  }
+  //allocate scratch space (also compiles expressions if that wasn't done above)
+  index = 0;
+  for (current = finder; current; current = current->next) {
+    index++;
+    if ((status = hs_finder_prepare_database(current, mode, hs_finder_get_database(current, mode))) != HS_SUCCESS) {
+      fprintf(stderr, "ERROR %i: Unable to prepare patterns of search instance %lu\n", (int)status, (unsigned long)index);
+      return status;
+    }
+  }
+  return HS_SUCCESS;
+}
+
+DLL_EXPORT_HS_FINDER size_t hs_finder_output_to_stream (void* callbackdata, const char* data, size_t datalen)
 {
-  return search_data_buffer_flush_fn(finder->searchdatabuffer, flushpos, finder->outputfn, finder->outputcallbackdata);
+  return fwrite(data, 1, datalen, (FILE*)callbackdata);
 }
 
-DLL_EXPORT_HS_FINDER size_t hs_finder_skip (struct hs_finder* finder, size_t flushpos)
+DLL_EXPORT_HS_FINDER size_t hs_finder_output_to_null (void* callbackdata, const char* data, size_t datalen)
 {
-  return search_data_buffer_flush_fn(finder->searchdatabuffer, flushpos, NULL, NULL);
+  return datalen;
 }
 
-DLL_EXPORT_HS_FINDER size_t hs_finder_output (struct hs_finder* finder, const char* data, size_t datalen)
+DLL_EXPORT_HS_FINDER size_t hs_finder_outputv_to_stream (void* callbackdata, const struct hs_finder_iovec* iov, size_t iovcnt)
 {
-  return (*finder->outputfn)(finder->outputcallbackdata, data, datalen);
+  size_t i;
+  size_t result = 0;
+  for (i = 0; i < iovcnt; i++)
+    result += fwrite(iov[i].data, 1, iov[i].datalen, (FILE*)callbackdata);
+  return result;
 }
 
+DLL_EXPORT_HS_FINDER size_t hs_finder_outputv_to_fd (void* callbackdata, const struct hs_finder_iovec* iov, size_t iovcnt)
+{
+  int fd = *(int*)callbackdata;
+  size_t result = 0;
+#ifdef _WIN32
+  size_t i;
+  int n;
+  const char* data;
+  size_t datalen;
+  for (i = 0; i < iovcnt; i++) {
+    data = iov[i].data;
+    datalen = iov[i].datalen;
+    while (datalen > 0) {
+      if ((n = _write(fd, data, (unsigned int)(datalen > INT_MAX ? INT_MAX : datalen))) <= 0)
+        return result;
+      data += n;
+      datalen -= n;
+      result += n;
+    }
+  }
+#else
+  int segments;
+  ssize_t n;
+  size_t batchlen;
+  size_t written = 0;
+  struct iovec segment[HS_WRITEV_MAX_SEGMENTS];
+  while (iovcnt > 0) {
+    //write as many segments as possible at once, starting after the part of the first segment already written
+    batchlen = 0;
+    for (segments = 0; segments < HS_WRITEV_MAX_SEGMENTS && (size_t)segments < iovcnt; segments++) {
+      segment[segments].iov_base = (void*)iov[segments].data;
+      segment[segments].iov_len = iov[segments].datalen;
+      batchlen += iov[segments].datalen;
+    }
+    segment[0].iov_base = (void*)(iov[0].data + written);
+    segment[0].iov_len -= written;
+    batchlen -= written;
+    while ((n = writev(fd, segment, segments)) < 0 && errno == EINTR)
+      ;
+    if (n < 0 || (n == 0 && batchlen > 0))
+      return result;
+    result += (size_t)n;
+    written += (size_t)n;
+    while (iovcnt > 0 && written >= iov[0].datalen) {
+      written -= iov[0].datalen;
+      iov++;
+      iovcnt--;
+    }
+  }
+#endif
+  return result;
+}
+
+static size_t hs_finder_output_to_output_buffer (void* callbackdata, const char* data, size_t datalen)
+{
+  return output_buffer_add_ref((struct output_buffer_struct*)callbackdata, data, datalen);
+}
+
+//set output function of last search instance (collected in output buffer if enabled, returns non-zero on error)
+static int hs_finder_set_final_output (struct hs_finder* finder, search_data_buffer_output_fn outputfn, hs_finder_outputv_fn outputvfn, void* callbackdata)
+{
+  deinitialize_output_buffer(finder->outputbuffer);
+  finder->outputbuffer = NULL;
+  if (outputvfn || finder->outputbuffersize > 0) {
+    if ((finder->outputbuffer = initialize_output_buffer((finder->outputbuffersize > 0 ? finder->outputbuffersize : HS_OUTPUT_BUFFER_SIZE), (outputfn ? outputfn : hs_finder_output_to_stream), outputvfn, callbackdata)) == NULL)
+      return 1;
+    finder->outputfn = hs_finder_output_to_output_buffer;
+    finder->outputcallbackdata = finder->outputbuffer;
+  } else {
+    finder->outputfn = (search_data_buffer_output_fn*)(outputfn ? outputfn : hs_finder_output_to_stream);
+    finder->outputcallbackdata = callbackdata;
+  }
+  return 0;
+}
+
+static size_t hs_finder_output_to_queue (void* callbackdata, const char* data, size_t datalen)
+{
+  return buffer_queue_write((struct buffer_queue_struct*)callbackdata, data, datalen);
+}
+
+static size_t hs_finder_output_to_buffer (void* callbackdata, const char* data, size_t datalen)
+{
+  search_data_buffer_add((struct search_data_buffer_struct*)callbackdata, data, datalen);
+  return datalen;
+}
+
+static int hs_finder_compare_profiles_by_id (const void* a, const void* b)
+{
+  const struct hs_finder_pattern_profile* pa = (const struct hs_finder_pattern_profile*)a;
+  const struct hs_finder_pattern_profile* pb = (const struct hs_finder_pattern_profile*)b;
+  if (pa->id != pb->id)
+    return (pa->id < pb->id ? -1 : 1);
+  return (pa->instance < pb->instance ? -1 : (pa->instance > pb->instance ? 1 : 0));
+}
+
+//set up per pattern statistics, sorted by id, with information about the expressions (returns non-zero on error)
+static int hs_finder_init_profile (struct hs_finder* finder)
+{
+  size_t i;
+  size_t j;
+  size_t n;
+  hs_expr_info_t* info;
+  hs_compile_error_t* compile_err;
+  struct hs_finder_pattern_profile* profile;
+  struct hyperscan_expr_list_struct* exprlist = finder->patterns->hyperscanexprlist;
+  const char* const* expressions = hyperscan_expr_list_get_expressions(exprlist);
+  const unsigned int* flags = hyperscan_expr_list_get_flags(exprlist);
+  const unsigned int* ids = hyperscan_expr_list_get_ids(exprlist);
+  const size_t* lengths = hyperscan_expr_list_get_lengths(exprlist);
+  free(finder->profile);
+  finder->profile = NULL;
+  finder->profilecount = 0;
+  if (!finder->profiling || (n = hyperscan_expr_list_count(exprlist)) == 0)
+    return 0;
+  if ((profile = (struct hs_finder_pattern_profile*)malloc(n * sizeof(struct hs_finder_pattern_profile))) == NULL)
+    return -1;
+  for (i = 0; i < n; i++) {
+    memset(&profile[i], 0, sizeof(struct hs_finder_pattern_profile));
+    //the instance field temporarily holds the index so the first expression of each id is kept after sorting
+    profile[i].instance = i;
+    profile[i].id = ids[i];
+    profile[i].expression = expressions[i];
+    profile[i].expressions = 1;
+    profile[i].maxwidth = UINT_MAX;
+    profile[i].anchored = ((expressions[i][0] == '^' && !(flags[i] & HS_FLAG_MULTILINE)) || strncmp(expressions[i], "\\A", 2) == 0);
+    if (lengths[i] > 0) {
+      profile[i].minwidth = (lengths[i] < UINT_MAX ? (unsigned int)lengths[i] : UINT_MAX);
+      profile[i].maxwidth = profile[i].minwidth;
+    } else if (hs_expression_info(expressions[i], flags[i], &info, &compile_err) == HS_SUCCESS) {
+      profile[i].minwidth = info->min_width;
+      profile[i].maxwidth = info->max_width;
+      profile[i].matchesateod = (info->matches_at_eod ? 1 : 0);
+      profile[i].matchesonlyateod = (info->matches_only_at_eod ? 1 : 0);
+      free(info);
+    } else {
+      hs_free_compile_error(compile_err);
+    }
+  }
+  qsort(profile, n, sizeof(struct hs_finder_pattern_profile), hs_finder_compare_profiles_by_id);
+  //combine expressions with the same id
+  j = 0;
+  for (i = 0; i < n; i++) {
+    if (j > 0 && profile[j - 1].id == profile[i].id) {
+      profile[j - 1].expressions++;
+      if (profile[i].minwidth < profile[j - 1].minwidth)
+        profile[j - 1].minwidth = profile[i].minwidth;
+      if (profile[i].maxwidth > profile[j - 1].maxwidth)
+        profile[j - 1].maxwidth = profile[i].maxwidth;
+      profile[j - 1].anchored &= profile[i].anchored;
+      profile[j - 1].matchesateod |= profile[i].matchesateod;
+      profile[j - 1].matchesonlyateod &= profile[i].matchesonlyateod;
+    } else {
+      profile[j++] = profile[i];
+    }
+  }
+  finder->profile = profile;
+  finder->profilecount = j;
+  return 0;
+}
+
+//find statistics of pattern id (returns NULL if not found)
+static struct hs_finder_pattern_profile* hs_finder_find_profile (struct hs_finder* finder, unsigned int id)
+{
+  size_t lo = 0;
+  size_t hi = finder->profilecount;
+  size_t mid;
+  while (lo < hi) {
+    mid = lo + (hi - lo) / 2;
+    if (finder->profile[mid].id < id)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return (lo < finder->profilecount && finder->profile[lo].id == id ? &finder->profile[lo] : NULL);
+}
+
+//add match to statistics of pattern id
+static void hs_finder_profile_match (struct hs_finder* finder, unsigned int id, unsigned long long callbacktime)
+{
+  struct hs_finder_pattern_profile* profile;
+  if ((profile = hs_finder_find_profile(finder, id)) != NULL) {
+    profile->matches++;
+    profile->callbacktime += callbacktime;
+  }
+}
+
+//add time spent on a match to the profile of its id
+static void hs_finder_profile_time (struct hs_finder* finder, unsigned int id, unsigned long long elapsed)
+{
+  struct hs_finder_pattern_profile* profile;
+  if ((profile = hs_finder_find_profile(finder, id)) != NULL)
+    profile->callbacktime += elapsed;
+}
+
+//add bytes that can't be flushed up to flushpos because the first match waiting to be replaced starts before it to the profile of its id
+static void hs_finder_profile_retained (struct hs_finder* finder, size_t flushpos)
+{
+  struct hs_finder_pattern_profile* profile;
+  if (finder->profile && finder->candidatecount > 0 && finder->candidates[0].from < flushpos) {
+    if ((profile = hs_finder_find_profile(finder, finder->candidates[0].id)) != NULL)
+      profile->retainedbytes += flushpos - finder->candidates[0].from;
+  }
+}
+
+//call match function and keep track of the time spent in it
+//(reading the clock for every match is expensive, so unless profiling only one in HS_CALLBACK_SAMPLE_INTERVAL calls is timed and the calls in between are counted at the last time measured)
+static int hs_finder_call_match_fn (struct hs_finder* finder, unsigned int id, unsigned long long from, unsigned long long to, unsigned int flags)
+{
+  int result = 0;
+  unsigned long long start;
+  unsigned long long elapsed = 0;
+  if (finder->matchfn) {
+    if (finder->profiling || (finder->callbackcount++ & (HS_CALLBACK_SAMPLE_INTERVAL - 1)) == 0) {
+      start = hs_finder_get_time();
+      result = (*finder->matchfn)(id, from, to, flags, finder);
+      elapsed = hs_finder_get_time() - start;
+      finder->sampledcallbacktime = elapsed;
+      finder->stats.callbacktime += elapsed;
+    } else {
+      result = (*finder->matchfn)(id, from, to, flags, finder);
+      finder->stats.callbacktime += finder->sampledcallbacktime;
+    }
+  }
+  if (finder->profile)
+    hs_finder_profile_match(finder, id, elapsed);
+  return result;
+}
+
+//match handler counting matches and passing them to the match function
+static int hs_finder_match (unsigned int id, unsigned long long from, unsigned long long to, unsigned int flags, void* context)
+{
+  struct hs_finder* finder = (struct hs_finder*)context;
+  finder->stats.matches++;
+  return hs_finder_call_match_fn(finder, id, from, to, flags);
+}
+
+//match handler collecting matches of expressions with a replacement (other matches are passed to the match function)
+static int hs_finder_replacement_match (unsigned int id, unsigned long long from, unsigned long long to, unsigned int flags, void* context)
+{
+  size_t i;
+  struct hs_finder* finder = (struct hs_finder*)context;
+  finder->stats.matches++;
+  if ((i = hs_finder_patterns_find_replacement(finder->patterns, id)) == finder->patterns->replacementcount)
+    return hs_finder_call_match_fn(finder, id, from, to, flags);
+  if (finder->profile)
+    hs_finder_profile_match(finder, id, 0);
+  if (finder->candidatecount == finder->candidatealloc) {
+    struct hs_finder_candidate* newcandidates;
+    size_t newcandidatealloc = (finder->candidatealloc < HS_REPLACEMENT_MIN_CANDIDATES ? HS_REPLACEMENT_MIN_CANDIDATES : finder->candidatealloc * 2);
+    if ((newcandidates = (struct hs_finder_candidate*)realloc(finder->candidates, newcandidatealloc * sizeof(struct hs_finder_candidate))) == NULL) {
+      fprintf(stderr, "ERROR: Memory allocation error for match at position %llu\n", from);
+      return 1;
+    }
+    finder->candidates = newcandidates;
+    finder->candidatealloc = newcandidatealloc;
+  }
+  finder->candidates[finder->candidatecount].from = from;
+  finder->candidates[finder->candidatecount].to = to;
+  finder->candidates[finder->candidatecount].id = id;
+  finder->candidates[finder->candidatecount].replacement = i;
+  finder->candidatecount++;
+  return 0;
+}
+
+//get match handler to pass to hyperscan
+static match_event_handler hs_finder_get_match_handler (struct hs_finder* finder)
+{
+  return (finder->patterns->replacementcount > 0 ? hs_finder_replacement_match : hs_finder_match);
+}
+
+//start measuring time spent in hyperscan, excluding time spent in match functions
+static unsigned long long hs_finder_start_scan_timer (struct hs_finder* finder)
+{
+  return hs_finder_get_time() - finder->stats.callbacktime;
+}
+
+//as the time spent in match functions is an estimate when not profiling it may exceed the time measured, so don't let the scan time go down
+static void hs_finder_stop_scan_timer (struct hs_finder* finder, unsigned long long start)
+{
+  unsigned long long elapsed = hs_finder_get_time() - start;
+  if (elapsed > finder->stats.callbacktime)
+    finder->stats.scantime += elapsed - finder->stats.callbacktime;
+}
+
+//keep track of the largest amount of data buffered
+static void hs_finder_update_buffer_stats (struct hs_finder* finder)
+{
+  size_t buflen = search_data_buffer_get_len(finder->searchdatabuffer);
+  if (buflen > finder->stats.peakbuffersize)
+    finder->stats.peakbuffersize = buflen;
+}
+
+//flush or discard buffered data and count the bytes
+static size_t hs_finder_flush_data (struct hs_finder* finder, size_t flushpos, int skip)
+{
+  size_t result;
+  size_t len;
+  size_t pos = search_data_buffer_get_pos(finder->searchdatabuffer);
+  if (skip) {
+    result = search_data_buffer_flush_fn(finder->searchdatabuffer, flushpos, NULL, NULL);
+    finder->stats.bytesskipped += search_data_buffer_get_pos(finder->searchdatabuffer) - pos;
+  } else {
+    result = search_data_buffer_flush_fn(finder->searchdatabuffer, flushpos, finder->outputfn, finder->outputcallbackdata);
+    len = search_data_buffer_get_pos(finder->searchdatabuffer) - pos;
+    finder->stats.bytesflushed += len;
+    if (finder->outputfn)
+      finder->stats.bytesoutput += len;
+  }
+  return result;
+}
+
+//flush all buffered data
+static void hs_finder_flush_remaining (struct hs_finder* finder)
+{
+  size_t len = search_data_buffer_get_len(finder->searchdatabuffer);
+  finder->stats.bytesflushed += len;
+  if (finder->outputfn)
+    finder->stats.bytesoutput += len;
+  search_data_buffer_flush_remaining_fn(finder->searchdatabuffer, finder->outputfn, finder->outputcallbackdata);
+}
+
+static int hs_finder_compare_candidates_by_position (const void* a, const void* b)
+{
+  const struct hs_finder_candidate* ca = (const struct hs_finder_candidate*)a;
+  const struct hs_finder_candidate* cb = (const struct hs_finder_candidate*)b;
+  if (ca->from != cb->from)
+    return (ca->from < cb->from ? -1 : 1);
+  if (ca->to != cb->to)
+    return (ca->to < cb->to ? -1 : 1);
+  return (ca->id < cb->id ? -1 : (ca->id > cb->id ? 1 : 0));
+}
+
+static int hs_finder_compare_candidates_leftmost_longest (const void* a, const void* b)
+{
+  const struct hs_finder_candidate* ca = (const struct hs_finder_candidate*)a;
+  const struct hs_finder_candidate* cb = (const struct hs_finder_candidate*)b;
+  if (ca->from != cb->from)
+    return (ca->from < cb->from ? -1 : 1);
+  if (ca->to != cb->to)
+    return (ca->to > cb->to ? -1 : 1);
+  return (ca->id < cb->id ? -1 : (ca->id > cb->id ? 1 : 0));
+}
+
+static int hs_finder_compare_candidates_by_priority (const void* a, const void* b)
+{
+  const struct hs_finder_candidate* ca = (const struct hs_finder_candidate*)a;
+  const struct hs_finder_candidate* cb = (const struct hs_finder_candidate*)b;
+  if (ca->id != cb->id)
+    return (ca->id < cb->id ? -1 : 1);
+  return hs_finder_compare_candidates_leftmost_longest(a, b);
+}
+
+//replace data of match
+static void hs_finder_apply_replacement (struct hs_finder* finder, const struct hs_finder_candidate* candidate)
+{
+  const struct hs_finder_replacement* replacement = &finder->patterns->replacements[candidate->replacement];
+  //data may already have been flushed when the buffer limit for expressions of unlimited width was reached
+  if (candidate->from < hs_finder_get_pos(finder))
+    return;
+  hs_finder_flush(finder, (size_t)candidate->from);
+  hs_finder_skip(finder, (size_t)candidate->to);
+  //the replacement data remains available, so it doesn't need to be copied into the output buffer
+  if (replacement->datalen > 0) {
+    if (finder->outputbuffer) {
+      output_buffer_add_ref(finder->outputbuffer, replacement->data, replacement->datalen);
+      finder->stats.bytesoutput += replacement->datalen;
+    } else {
+      hs_finder_output(finder, replacement->data, replacement->datalen);
+    }
+  }
+  finder->replacementcounts[candidate->replacement]++;
+}
+
+//choose which of a group of overlapping matches to replace according to the overlap policy
+static void hs_finder_apply_replacement_group (struct hs_finder* finder, struct hs_finder_candidate* group, size_t groupsize)
+{
+  size_t i;
+  size_t j;
+  size_t accepted;
+  struct hs_finder_candidate swap;
+  unsigned long long start;
+  unsigned long long elapsed;
+  //when profiling the time spent on replacements is added to the profile of their ids
+  start = (finder->profile ? hs_finder_get_time() : 0);
+  if (groupsize > 1) {
+    //sort by preference (first-start order is the same as position order)
+    if (finder->overlappolicy == HS_FINDER_OVERLAP_PRIORITY)
+      qsort(group, groupsize, sizeof(struct hs_finder_candidate), hs_finder_compare_candidates_by_priority);
+    else if (finder->overlappolicy != HS_FINDER_OVERLAP_FIRST_START)
+      qsort(group, groupsize, sizeof(struct hs_finder_candidate), hs_finder_compare_candidates_leftmost_longest);
+    //accept matches not overlapping with better ones (moved to the front)
+    accepted = 0;
+    for (i = 0; i < groupsize; i++) {
+      for (j = 0; j < accepted; j++) {
+        if (group[i].from < group[j].to && group[j].from < group[i].to)
+          break;
+      }
+      if (j == accepted) {
+        swap = group[accepted];
+        group[accepted++] = group[i];
+        group[i] = swap;
+      }
+    }
+    //the time spent choosing is shared by all matches of the group
+    if (finder->profile) {
+      elapsed = (hs_finder_get_time() - start) / groupsize;
+      for (i = 0; i < groupsize; i++)
+        hs_finder_profile_time(finder, group[i].id, elapsed);
+    }
+    groupsize = accepted;
+    if (finder->overlappolicy == HS_FINDER_OVERLAP_PRIORITY)
+      qsort(group, groupsize, sizeof(struct hs_finder_candidate), hs_finder_compare_candidates_by_position);
+  }
+  for (i = 0; i < groupsize; i++) {
+    if (finder->profile) {
+      start = hs_finder_get_time();
+      hs_finder_apply_replacement(finder, &group[i]);
+      hs_finder_profile_time(finder, group[i].id, hs_finder_get_time() - start);
+    } else {
+      hs_finder_apply_replacement(finder, &group[i]);
+    }
+  }
+}
+
+/* replace matches that can't overlap with matches found later (groups of overlapping matches all ending at or before limit)
+   and keep the others, sorted by position
+*/
+static void hs_finder_resolve_replacements (struct hs_finder* finder, unsigned long long limit)
+{
+  size_t i;
+  size_t j;
+  unsigned long long groupend;
+  struct hs_finder_candidate* candidates = finder->candidates;
+  size_t n = finder->candidatecount;
+  if (n == 0)
+    return;
+  //matches are reported in order of end position, only sort if needed
+  for (i = 1; i < n; i++) {
+    if (hs_finder_compare_candidates_by_position(&candidates[i - 1], &candidates[i]) > 0) {
+      qsort(candidates, n, sizeof(struct hs_finder_candidate), hs_finder_compare_candidates_by_position);
+      break;
+    }
+  }
+  i = 0;
+  while (i < n) {
+    //determine group of overlapping matches
+    groupend = candidates[i].to;
+    for (j = i + 1; j < n && candidates[j].from < groupend; j++) {
+      if (candidates[j].to > groupend)
+        groupend = candidates[j].to;
+    }
+    if (groupend > limit)
+      break;
+    hs_finder_apply_replacement_group(finder, candidates + i, j - i);
+    i = j;
+  }
+  if (i > 0) {
+    memmove(candidates, candidates + i, (n - i) * sizeof(struct hs_finder_candidate));
+    finder->candidatecount = n - i;
+  }
+}
+
+//get position up to which matches can be replaced without knowing matches in data not processed yet
+static unsigned long long hs_finder_get_replacement_limit (struct hs_finder* finder)
+{
+  unsigned int maxmatchwidth = finder->patterns->maxmatchwidth;
+  if (maxmatchwidth != UINT_MAX)
+    return (finder->scanpos > maxmatchwidth ? finder->scanpos - maxmatchwidth : 0);
+  if (finder->maxbuffersize > 0)
+    return (finder->scanpos > finder->maxbuffersize ? finder->scanpos - finder->maxbuffersize : 0);
+  return 0;
+}
+
+//prepare replacing matches for a new data stream (returns non-zero on error)
+static int hs_finder_reset_replacements (struct hs_finder* finder)
+{
+  size_t n = finder->patterns->replacementcount;
+  finder->candidatecount = 0;
+  finder->scanpos = 0;
+  if (n > finder->replacementcountslen) {
+    size_t* newcounts;
+    if ((newcounts = (size_t*)realloc(finder->replacementcounts, n * sizeof(size_t))) == NULL)
+      return 1;
+    finder->replacementcounts = newcounts;
+  }
+  finder->replacementcountslen = n;
+  if (n > 0)
+    memset(finder->replacementcounts, 0, n * sizeof(size_t));
+  return 0;
+}
+
+static hs_error_t hs_finder_close_from (struct hs_finder* finder);
+
+static void* hs_finder_pipeline_thread (void* param)
+{
+  hs_error_t status;
+  const char* data;
+  size_t datalen;
+  struct hs_finder* finder = (struct hs_finder*)param;
+  //process data from previous search instance until it is closed
+  while ((data = buffer_queue_read(finder->inputqueue, &datalen)) != NULL) {
+    if ((status = hs_finder_process(finder, data, datalen)) != HS_SUCCESS && finder->threadstatus == HS_SUCCESS)
+      finder->threadstatus = status;
+    buffer_queue_release(finder->inputqueue);
+  }
+  if ((status = hs_finder_close_from(finder)) != HS_SUCCESS && finder->threadstatus == HS_SUCCESS)
+    finder->threadstatus = status;
+  return NULL;
+}
+
+static hs_error_t hs_finder_start_pipeline (struct hs_finder* finder)
+{
+  struct hs_finder* current;
+  for (current = finder; current->next; current = current->next) {
+    if (!current->next->inputqueue) {
+      if ((current->next->inputqueue = initialize_buffer_queue(HS_PIPELINE_BUFFERS, HS_PIPELINE_BUFFER_SIZE)) == NULL)
+        return HS_NOMEM;
+    } else {
+      reset_buffer_queue(current->next->inputqueue);
+    }
+    current->next->threadstatus = HS_SUCCESS;
+    if (pthread_create(&current->next->thread, NULL, hs_finder_pipeline_thread, current->next) != 0) {
+      fprintf(stderr, "ERROR: Unable to create thread for search instance\n");
+      return HS_UNKNOWN_ERROR;
+    }
+    current->next->threadrunning = 1;
+    //send output to the input queue of the next search instance instead of processing it directly
+    current->outputfn = hs_finder_output_to_queue;
+    current->outputcallbackdata = current->next->inputqueue;
+  }
+  return HS_SUCCESS;
+}
+
+//delete last instance if expression list is empty
+static void hs_finder_remove_empty_instance (struct hs_finder* finder)
+{
+  if (hyperscan_expr_list_count(finder->last->patterns->hyperscanexprlist) == 0) {
+    struct hs_finder* current;
+    current = finder;
+    while (current) {
+      if (current->next == finder->last)
+        break;
+      current = current->next;
+    }
+    if (current) {
+      hs_finder_cleanup(finder->last);
+      current->next = NULL;
+      finder->last = current;
+    }
+  }
+}
+
+static hs_error_t hs_finder_open_instances (struct hs_finder* finder, search_data_buffer_output_fn outputfn, hs_finder_outputv_fn outputvfn, void* callbackdata, int scanonly)
+{
+  hs_error_t status;
+  struct hs_finder* current = finder;
+  hs_finder_remove_empty_instance(finder);
+  //compile expressions of all search instances (or load them from cache), keep database, scratch space and stream from previous run if expressions didn't change
+  status = hs_finder_prepare_databases(finder, HS_MODE_STREAM);
+  while (current && status == HS_SUCCESS) {
+    //set output function (daisy chain with next if not last in chain, otherwise set final output function)
+    current->scanonly = scanonly;
+    deinitialize_output_buffer(current->outputbuffer);
+    current->outputbuffer = NULL;
+    if (scanonly) {
+      current->outputfn = NULL;
+      current->outputcallbackdata = NULL;
+    } else if (current->next) {
+      current->outputfn = (hs_finder_output_fn)hs_finder_process;
+      current->outputcallbackdata = current->next;
+    } else if (hs_finder_set_final_output(current, outputfn, outputvfn, callbackdata) != 0) {
+      status = HS_NOMEM;
+      break;
+    }
+    //reset output buffer
+    reset_search_data_buffer(current->searchdatabuffer);
+    if (hs_finder_reset_replacements(current) != 0) {
+      status = HS_NOMEM;
+      break;
+    }
+    memset(&current->stats, 0, sizeof(current->stats));
+    current->callbackcount = 0;
+    current->sampledcallbacktime = 0;
+    //discard state of suspended stream from previous run
+    if (current->suspendedstream) {
+      free(current->suspendedstream);
+      current->suspendedstream = NULL;
+      current->suspendedstreamlen = 0;
+    }
+    if (hs_finder_init_profile(current) != 0)
+      status = HS_NOMEM;
+    //open stream
+    if (status == HS_SUCCESS && !current->stream) {
+      if ((status = hs_open_stream(current->patterns->stream.database, 0, &current->stream)) != HS_SUCCESS) {
+        fprintf(stderr, "ERROR %i: Unable to open scan input stream. Exiting.\n", (int)status);
+        current->stream = NULL;
+      }
+    }
+    current = current->next;
+  }
+  //run each search instance in its own thread
+  if (status == HS_SUCCESS && finder->pipeline && !scanonly && finder->next) {
+    if ((status = hs_finder_start_pipeline(finder)) != HS_SUCCESS)
+      hs_finder_close(finder);
+  }
+  return status;
+}
+
+DLL_EXPORT_HS_FINDER hs_error_t hs_finder_open (struct hs_finder* finder, search_data_buffer_output_fn outputfn, void* callbackdata)
+{
+  return hs_finder_open_instances(finder, outputfn, NULL, callbackdata, 0);
+}
+
+DLL_EXPORT_HS_FINDER hs_error_t hs_finder_open_v (struct hs_finder* finder, hs_finder_outputv_fn outputvfn, void* callbackdata)
+{
+  if (!outputvfn)
+    return HS_INVALID;
+  return hs_finder_open_instances(finder, NULL, outputvfn, callbackdata, 0);
+}
+
+DLL_EXPORT_HS_FINDER hs_error_t hs_finder_open_scan_only (struct hs_finder* finder)
+{
+  return hs_finder_open_instances(finder, NULL, NULL, NULL, 1);
+}
+
+//restore stream of suspended search instance, reusing a stream closed by another suspended instance if possible
+static hs_error_t hs_finder_resume_instance (struct hs_finder* finder)
+{
+  hs_error_t status;
+  hs_stream_t* stream = NULL;
+  struct hs_finder_patterns* patterns = finder->patterns;
+  pthread_mutex_lock(&patterns->lock);
+  if (patterns->streampoolcount > 0)
+    stream = patterns->streampool[--patterns->streampoolcount];
+  pthread_mutex_unlock(&patterns->lock);
+  if (stream) {
+    if ((status = hs_reset_and_expand_stream(stream, finder->suspendedstream, finder->suspendedstreamlen, NULL, NULL, NULL)) != HS_SUCCESS)
+      hs_close_stream(stream, NULL, NULL, NULL);
+  } else {
+    status = hs_expand_stream(patterns->stream.database, &stream, finder->suspendedstream, finder->suspendedstreamlen);
+  }
+  if (status != HS_SUCCESS) {
+    fprintf(stderr, "ERROR %i: Unable to restore state of suspended stream\n", (int)status);
+    return status;
+  }
+  finder->stream = stream;
+  free(finder->suspendedstream);
+  finder->suspendedstream = NULL;
+  finder->suspendedstreamlen = 0;
+  return HS_SUCCESS;
+}
+
+//get compressed state of stream in newly allocated memory
+static hs_error_t hs_finder_compress_stream (hs_stream_t* stream, char** state, size_t* statelen)
+{
+  hs_error_t status;
+  size_t len = 0;
+  //determine size of compressed stream state
+  if ((status = hs_compress_stream(stream, NULL, 0, &len)) != HS_INSUFFICIENT_SPACE && status != HS_SUCCESS) {
+    fprintf(stderr, "ERROR %i in hs_compress_stream()\n", (int)status);
+    return status;
+  }
+  if ((*state = (char*)malloc(len > 0 ? len : 1)) == NULL)
+    return HS_NOMEM;
+  if ((status = hs_compress_stream(stream, *state, len, statelen)) != HS_SUCCESS) {
+    fprintf(stderr, "ERROR %i in hs_compress_stream()\n", (int)status);
+    free(*state);
+    *state = NULL;
+    *statelen = 0;
+  }
+  return status;
+}
+
+//release stream of search instance, keeping it for reuse when resuming
+static void hs_finder_release_stream (struct hs_finder* finder)
+{
+  struct hs_finder_patterns* patterns = finder->patterns;
+  pthread_mutex_lock(&patterns->lock);
+  if (patterns->streampoolcount < HS_STREAM_POOL_SIZE) {
+    patterns->streampool[patterns->streampoolcount++] = finder->stream;
+    finder->stream = NULL;
+  }
+  pthread_mutex_unlock(&patterns->lock);
+  if (finder->stream) {
+    hs_close_stream(finder->stream, NULL, NULL, NULL);
+    finder->stream = NULL;
+  }
+}
+
+//save compressed state of stream of search instance and release memory not needed until more data is processed
+static hs_error_t hs_finder_suspend_instance (struct hs_finder* finder)
+{
+  hs_error_t status;
+  if (!finder->stream || finder->suspendedstream)
+    return HS_SUCCESS;
+  if ((status = hs_finder_compress_stream(finder->stream, &finder->suspendedstream, &finder->suspendedstreamlen)) != HS_SUCCESS)
+    return status;
+  hs_finder_release_stream(finder);
+  //only keep data that can still be part of a match
+  search_data_buffer_shrink(finder->searchdatabuffer);
+  if (finder->outputbuffer) {
+    output_buffer_flush(finder->outputbuffer);
+    output_buffer_shrink(finder->outputbuffer);
+  }
+  if (finder->candidatecount == 0) {
+    free(finder->candidates);
+    finder->candidates = NULL;
+    finder->candidatealloc = 0;
+  }
+  return HS_SUCCESS;
+}
+
+DLL_EXPORT_HS_FINDER hs_error_t hs_finder_suspend (struct hs_finder* finder)
+{
+  hs_error_t status;
+  struct hs_finder* current;
+  //threads of pipelined mode may still be using their streams
+  for (current = finder; current; current = current->next) {
+    if (current->threadrunning)
+      return HS_INVALID;
+  }
+  for (current = finder; current; current = current->next) {
+    if ((status = hs_finder_suspend_instance(current)) != HS_SUCCESS)
+      return status;
+  }
+  return HS_SUCCESS;
+}
+
+DLL_EXPORT_HS_FINDER hs_error_t hs_finder_resume (struct hs_finder* finder)
+{
+  hs_error_t status;
+  struct hs_finder* current;
+  for (current = finder; current; current = current->next) {
+    if (current->suspendedstream && (status = hs_finder_resume_instance(current)) != HS_SUCCESS)
+      return status;
+  }
+  return HS_SUCCESS;
+}
+
+//scan data with stream of search instance, using scratch space not in use by another thread
+static hs_error_t hs_finder_scan_stream (struct hs_finder* finder, const char* data, size_t datalen)
+{
+  hs_error_t status;
+  hs_scratch_t* scratch;
+  unsigned long long timer;
+  //resume search instance automatically when more data arrives
+  if (finder->suspendedstream && (status = hs_finder_resume_instance(finder)) != HS_SUCCESS)
+    return status;
+  if ((scratch = hyperscan_scratch_pool_acquire(finder->patterns->stream.scratchpool)) == NULL) {
+    fprintf(stderr, "ERROR: Unable to allocate scratch space\n");
+    return HS_NOMEM;
+  }
+  timer = hs_finder_start_scan_timer(finder);
+  if ((status = hs_scan_stream(finder->stream, data, datalen, 0, scratch, hs_finder_get_match_handler(finder), finder)) != HS_SUCCESS)
+    fprintf(stderr, "ERROR %i in hs_scan_stream()\n", (int)status);
+  hs_finder_stop_scan_timer(finder, timer);
+  hyperscan_scratch_pool_release(finder->patterns->stream.scratchpool, scratch);
+  finder->scanpos += datalen;
+  finder->stats.bytesscanned += datalen;
+  //replace matches that can no longer overlap with matches found later
+  if (finder->candidatecount > 0)
+    hs_finder_resolve_replacements(finder, hs_finder_get_replacement_limit(finder));
+  return status;
+}
+
+DLL_EXPORT_HS_FINDER hs_error_t hs_finder_process (struct hs_finder* finder, const char* data, size_t datalen)
+{
+  struct hs_finder_iovec iov;
+  iov.data = data;
+  iov.datalen = datalen;
+  return hs_finder_process_iov(finder, &iov, 1);
+}
+
+DLL_EXPORT_HS_FINDER hs_error_t hs_finder_process_iov (struct hs_finder* finder, const struct hs_finder_iovec* iov, size_t iovcnt)
+{
+  size_t i;
+  hs_error_t status;
+  size_t buflen;
+  size_t datalen = 0;
+  hs_error_t result = HS_SUCCESS;
+  unsigned int maxmatchwidth = finder->patterns->maxmatchwidth;
+  for (i = 0; i < iovcnt; i++)
+    datalen += iov[i].datalen;
+  if (datalen == 0)
+    return HS_SUCCESS;
+  //scan data directly with all instances without buffering when only scanning
+  if (finder->scanonly) {
+    struct hs_finder* current;
+    for (current = finder; current; current = current->next) {
+      for (i = 0; i < iovcnt; i++) {
+        if (iov[i].datalen > 0 && (status = hs_finder_scan_stream(current, iov[i].data, iov[i].datalen)) != HS_SUCCESS)
+          result = status;
+      }
+    }
+    return result;
+  }
+  //flush buffer in case it gets too large (only if matches can be arbitrarily long)
+  if (maxmatchwidth == UINT_MAX && finder->maxbuffersize > 0) {
+    if ((buflen = search_data_buffer_get_len(finder->searchdatabuffer)) + datalen > finder->maxbuffersize) {
+      size_t flushpos = search_data_buffer_get_pos(finder->searchdatabuffer) + buflen + datalen - finder->maxbuffersize;
+      if (finder->candidatecount > 0)
+        hs_finder_resolve_replacements(finder, flushpos);
+      hs_finder_flush_data(finder, flushpos, 0);
+      //the output buffer may refer to buffered data, which can be moved when new data is added
+      if (finder->outputbuffer)
+        output_buffer_detach(finder->outputbuffer);
+    }
+  }
+  //add new data to buffer without copying it, so data that is flushed right away is passed to the output function from the caller's buffer
+  for (i = 0; i < iovcnt; i++)
+    search_data_buffer_add_external(finder->searchdatabuffer, iov[i].data, iov[i].datalen);
+  hs_finder_update_buffer_stats(finder);
+  //scan new data (hyperscan can only scan one segment at a time in streaming mode)
+  for (i = 0; i < iovcnt; i++) {
+    if (iov[i].datalen > 0 && (status = hs_finder_scan_stream(finder, iov[i].data, iov[i].datalen)) != HS_SUCCESS && result == HS_SUCCESS)
+      result = status;
+  }
+  //flush data that can no longer be part of a match (or of a match that may still be replaced)
+  if (maxmatchwidth == UINT_MAX) {
+    //data is kept until the maximum buffer size is reached, matches waiting to be replaced keep it from their start
+    hs_finder_profile_retained(finder, search_data_buffer_get_pos(finder->searchdatabuffer) + search_data_buffer_get_len(finder->searchdatabuffer));
+  } else {
+    size_t endpos = search_data_buffer_get_pos(finder->searchdatabuffer) + search_data_buffer_get_len(finder->searchdatabuffer);
+    if (endpos >= maxmatchwidth) {
+      size_t flushpos = endpos + 1 - maxmatchwidth;
+      if (finder->candidatecount > 0 && finder->candidates[0].from < flushpos) {
+        hs_finder_profile_retained(finder, flushpos);
+        flushpos = (size_t)finder->candidates[0].from;
+      }
+      hs_finder_flush_data(finder, flushpos, 0);
+    }
+  }
+  //the data referred to by the output buffer may be moved or belong to the caller
+  if (finder->outputbuffer)
+    output_buffer_detach(finder->outputbuffer);
+  //only copy the data that can still be part of a match
+  search_data_buffer_detach(finder->searchdatabuffer);
+  return result;
+}
+
+//close search instances starting at finder, up to the next search instance that runs in its own thread
+static hs_error_t hs_finder_close_from (struct hs_finder* finder)
+{
+  hs_error_t status;
+  hs_scratch_t* scratch;
+  unsigned long long timer;
+  hs_error_t result = HS_SUCCESS;
+  struct hs_finder* current = finder;
+  while (current) {
+    //report matches at end of data and reset stream so it can be reused by the next call to hs_finder_open()
+    //(buffered data is still passed on if the state of a suspended stream can't be restored)
+    status = HS_SUCCESS;
+    if (current->suspendedstream)
+      status = hs_finder_resume_instance(current);
+    if (status == HS_SUCCESS) {
+      if ((scratch = hyperscan_scratch_pool_acquire(current->patterns->stream.scratchpool)) == NULL) {
+        fprintf(stderr, "ERROR: Unable to allocate scratch space\n");
+        status = HS_NOMEM;
+      } else {
+        timer = hs_finder_start_scan_timer(current);
+        if ((status = hs_reset_stream(current->stream, 0, scratch, hs_finder_get_match_handler(current), current)) != HS_SUCCESS)
+          fprintf(stderr, "ERROR %i in hs_reset_stream()\n", (int)status);
+        hs_finder_stop_scan_timer(current, timer);
+        hyperscan_scratch_pool_release(current->patterns->stream.scratchpool, scratch);
+      }
+    }
+    //replace all remaining matches
+    hs_finder_resolve_replacements(current, ULLONG_MAX);
+    if (status != HS_SUCCESS && result == HS_SUCCESS)
+      result = status;
+    hs_finder_flush_remaining(current);
+    if (current->outputbuffer)
+      output_buffer_flush(current->outputbuffer);
+    //signal end of data to next search instance if it runs in its own thread
+    if (current->next && current->next->threadrunning) {
+      buffer_queue_close(current->next->inputqueue);
+      break;
+    }
+    current = current->next;
+  }
+  return result;
+}
+
+DLL_EXPORT_HS_FINDER hs_error_t hs_finder_close (struct hs_finder* finder)
+{
+  hs_error_t status;
+  struct hs_finder* current;
+  status = hs_finder_close_from(finder);
+  //wait for threads to finish in pipelined mode
+  for (current = finder->next; current; current = current->next) {
+    if (current->threadrunning) {
+      pthread_join(current->thread, NULL);
+      current->threadrunning = 0;
+      if (status == HS_SUCCESS)
+        status = current->threadstatus;
+    }
+  }
+  return status;
+}
+
+DLL_EXPORT_HS_FINDER void hs_finder_flush_output (struct hs_finder* finder)
+{
+  struct hs_finder* current;
+  for (current = finder; current; current = current->next) {
+    if (current->outputbuffer)
+      output_buffer_flush(current->outputbuffer);
+  }
+}
+
+//identifies checkpoint files and the version of their layout
+#define HS_FINDER_CHECKPOINT_SIGNATURE "HSFCHKP1"
+
+static int hs_finder_checkpoint_write (FILE* dst, const void* data, size_t datalen)
+{
+  return (datalen == 0 || fwrite(data, 1, datalen, dst) == datalen);
+}
+
+static int hs_finder_checkpoint_write_value (FILE* dst, unsigned long long value)
+{
+  return hs_finder_checkpoint_write(dst, &value, sizeof(value));
+}
+
+static int hs_finder_checkpoint_read (FILE* src, void* data, size_t datalen)
+{
+  return (datalen == 0 || fread(data, 1, datalen, src) == datalen);
+}
+
+static int hs_finder_checkpoint_read_value (FILE* src, unsigned long long* value)
+{
+  return hs_finder_checkpoint_read(src, value, sizeof(*value));
+}
+
+//identify expressions of search instance, so a checkpoint is only loaded for the same expressions
+static unsigned long long hs_finder_checkpoint_key (struct hs_finder* finder)
+{
+  return hyperscan_db_cache_key(finder->patterns->hyperscanexprlist, hs_finder_get_compile_mode(finder->patterns, HS_MODE_STREAM), hs_finder_get_platform(finder->patterns), hs_finder_get_flags_mask(finder->patterns));
+}
+
+//write state of search instance to checkpoint file (returns non-zero on error)
+static int hs_finder_save_instance_checkpoint (struct hs_finder* finder, FILE* dst)
+{
+  size_t i;
+  char* state;
+  size_t statelen;
+  size_t bufferpos;
+  size_t bufferlen;
+  int result;
+  //stream state is saved in compressed form (already available for suspended search instances)
+  if (finder->suspendedstream) {
+    state = finder->suspendedstream;
+    statelen = finder->suspendedstreamlen;
+  } else if (hs_finder_compress_stream(finder->stream, &state, &statelen) != HS_SUCCESS) {
+    return 1;
+  }
+  bufferpos = search_data_buffer_get_pos(finder->searchdatabuffer);
+  bufferlen = search_data_buffer_get_len(finder->searchdatabuffer);
+  result = (
+    hs_finder_checkpoint_write_value(dst, hs_finder_checkpoint_key(finder)) &&
+    hs_finder_checkpoint_write_value(dst, statelen) &&
+    hs_finder_checkpoint_write(dst, state, statelen) &&
+    hs_finder_checkpoint_write_value(dst, finder->scanpos) &&
+    hs_finder_checkpoint_write_value(dst, bufferpos) &&
+    hs_finder_checkpoint_write_value(dst, bufferlen) &&
+    hs_finder_checkpoint_write(dst, (bufferlen > 0 ? search_data_buffer_get_at_pos(finder->searchdatabuffer, bufferpos) : NULL), bufferlen) &&
+    hs_finder_checkpoint_write_value(dst, finder->candidatecount)
+  );
+  if (state != finder->suspendedstream)
+    free(state);
+  for (i = 0; result && i < finder->candidatecount; i++) {
+    result = (
+      hs_finder_checkpoint_write_value(dst, finder->candidates[i].from) &&
+      hs_finder_checkpoint_write_value(dst, finder->candidates[i].to) &&
+      hs_finder_checkpoint_write_value(dst, finder->candidates[i].id) &&
+      hs_finder_checkpoint_write_value(dst, finder->candidates[i].replacement)
+    );
+  }
+  result = result && hs_finder_checkpoint_write_value(dst, finder->replacementcountslen);
+  for (i = 0; result && i < finder->replacementcountslen; i++)
+    result = hs_finder_checkpoint_write_value(dst, finder->replacementcounts[i]);
+  result = (result &&
+    hs_finder_checkpoint_write_value(dst, finder->stats.bytesscanned) &&
+    hs_finder_checkpoint_write_value(dst, finder->stats.matches) &&
+    hs_finder_checkpoint_write_value(dst, finder->stats.bytesflushed) &&
+    hs_finder_checkpoint_write_value(dst, finder->stats.bytesskipped) &&
+    hs_finder_checkpoint_write_value(dst, finder->stats.bytesoutput) &&
+    hs_finder_checkpoint_write_value(dst, finder->stats.peakbuffersize) &&
+    hs_finder_checkpoint_write_value(dst, finder->stats.scantime) &&
+    hs_finder_checkpoint_write_value(dst, finder->stats.callbacktime) &&
+    hs_finder_checkpoint_write_value(dst, finder->profilecount)
+  );
+  for (i = 0; result && i < finder->profilecount; i++) {
+    result = (
+      hs_finder_checkpoint_write_value(dst, finder->profile[i].id) &&
+      hs_finder_checkpoint_write_value(dst, finder->profile[i].matches) &&
+      hs_finder_checkpoint_write_value(dst, finder->profile[i].callbacktime) &&
+      hs_finder_checkpoint_write_value(dst, finder->profile[i].retainedbytes)
+    );
+  }
+  return !result;
+}
+
+DLL_EXPORT_HS_FINDER hs_error_t hs_finder_save_checkpoint (struct hs_finder* finder, const char* filename, unsigned long long inputpos, const void* appdata, size_t appdatalen)
+{
+  FILE* dst;
+  char* tmpfilename;
+  struct hs_finder* current;
+  size_t instances = 0;
+  int result;
+  //all search instances must have been opened and none can be running in its own thread
+  for (current = finder; current; current = current->next) {
+    if (current->threadrunning || (!current->stream && !current->suspendedstream))
+      return HS_INVALID;
+    instances++;
+  }
+  //output up to this point must be passed on before the checkpoint refers to it
+  hs_finder_flush_output(finder);
+  //write to temporary file first so an interrupted write never replaces the previous checkpoint
+  if ((tmpfilename = (char*)malloc(strlen(filename) + 5)) == NULL)
+    return HS_NOMEM;
+  sprintf(tmpfilename, "%s.tmp", filename);
+  if ((dst = fopen(tmpfilename, "wb")) == NULL) {
+    fprintf(stderr, "ERROR: Unable to create checkpoint file: %s\n", tmpfilename);
+    free(tmpfilename);
+    return HS_UNKNOWN_ERROR;
+  }
+  result = (
+    hs_finder_checkpoint_write(dst, HS_FINDER_CHECKPOINT_SIGNATURE, 8) &&
+    hs_finder_checkpoint_write_value(dst, inputpos) &&
+    hs_finder_checkpoint_write_value(dst, appdatalen) &&
+    hs_finder_checkpoint_write(dst, appdata, appdatalen) &&
+    hs_finder_checkpoint_write_value(dst, instances)
+  );
+  for (current = finder; result && current; current = current->next)
+    result = (hs_finder_save_instance_checkpoint(current, dst) == 0);
+  //make sure the data is on disk before the checkpoint replaces the previous one
+  result = (fflush(dst) == 0) && result;
+#ifdef _WIN32
+  result = result && (_commit(_fileno(dst)) == 0);
+#else
+  result = result && (fsync(fileno(dst)) == 0);
+#endif
+  result = (fclose(dst) == 0) && result;
+#ifdef _WIN32
+  result = result && MoveFileExA(tmpfilename, filename, MOVEFILE_REPLACE_EXISTING);
+#else
+  result = result && (rename(tmpfilename, filename) == 0);
+#endif
+  if (!result) {
+    fprintf(stderr, "ERROR: Unable to write checkpoint file: %s\n", filename);
+    remove(tmpfilename);
+  }
+  free(tmpfilename);
+  return (result ? HS_SUCCESS : HS_UNKNOWN_ERROR);
+}
+
+//restore state of search instance from checkpoint file (returns non-zero on error)
+static int hs_finder_load_instance_checkpoint (struct hs_finder* finder, FILE* src)
+{
+  size_t i;
+  char* data;
+  unsigned long long key;
+  unsigned long long len;
+  unsigned long long bufferpos;
+  unsigned long long candidatecount;
+  unsigned long long values[4];
+  struct hs_finder_pattern_profile* profile;
+  //only load checkpoint saved with the same expressions
+  if (!hs_finder_checkpoint_read_value(src, &key) || key != hs_finder_checkpoint_key(finder))
+    return 1;
+  //stream state is expanded when the search instance is resumed
+  if (!hs_finder_checkpoint_read_value(src, &len) || (data = (char*)malloc(len > 0 ? (size_t)len : 1)) == NULL)
+    return 1;
+  if (!hs_finder_checkpoint_read(src, data, (size_t)len)) {
+    free(data);
+    return 1;
+  }
+  if (finder->stream)
+    hs_finder_release_stream(finder);
+  free(finder->suspendedstream);
+  finder->suspendedstream = data;
+  finder->suspendedstreamlen = (size_t)len;
+  if (hs_finder_resume_instance(finder) != HS_SUCCESS)
+    return 1;
+  //buffered data not flushed yet
+  if (!hs_finder_checkpoint_read_value(src, &finder->scanpos) || !hs_finder_checkpoint_read_value(src, &bufferpos) || !hs_finder_checkpoint_read_value(src, &len))
+    return 1;
+  reset_search_data_buffer(finder->searchdatabuffer);
+  search_data_buffer_set_pos(finder->searchdatabuffer, (size_t)bufferpos);
+  if (len > 0) {
+    if ((data = (char*)malloc((size_t)len)) == NULL)
+      return 1;
+    if (!hs_finder_checkpoint_read(src, data, (size_t)len)) {
+      free(data);
+      return 1;
+    }
+    search_data_buffer_add(finder->searchdatabuffer, data, (size_t)len);
+    free(data);
+  }
+  //matches not replaced yet
+  if (!hs_finder_checkpoint_read_value(src, &candidatecount))
+    return 1;
+  if (candidatecount > finder->candidatealloc) {
+    struct hs_finder_candidate* newcandidates;
+    if ((newcandidates = (struct hs_finder_candidate*)realloc(finder->candidates, (size_t)candidatecount * sizeof(struct hs_finder_candidate))) == NULL)
+      return 1;
+    finder->candidates = newcandidates;
+    finder->candidatealloc = (size_t)candidatecount;
+  }
+  for (i = 0; i < candidatecount; i++) {
+    if (!hs_finder_checkpoint_read_value(src, &values[0]) || !hs_finder_checkpoint_read_value(src, &values[1]) || !hs_finder_checkpoint_read_value(src, &values[2]) || !hs_finder_checkpoint_read_value(src, &values[3]))
+      return 1;
+    finder->candidates[i].from = values[0];
+    finder->candidates[i].to = values[1];
+    finder->candidates[i].id = (unsigned int)values[2];
+    finder->candidates[i].replacement = (size_t)values[3];
+  }
+  finder->candidatecount = (size_t)candidatecount;
+  //counters
+  if (!hs_finder_checkpoint_read_value(src, &len) || len != finder->replacementcountslen)
+    return 1;
+  for (i = 0; i < finder->replacementcountslen; i++) {
+    if (!hs_finder_checkpoint_read_value(src, &values[0]))
+      return 1;
+    finder->replacementcounts[i] = (size_t)values[0];
+  }
+  if (!hs_finder_checkpoint_read_value(src, &finder->stats.bytesscanned) ||
+      !hs_finder_checkpoint_read_value(src, &finder->stats.matches) ||
+      !hs_finder_checkpoint_read_value(src, &finder->stats.bytesflushed) ||
+      !hs_finder_checkpoint_read_value(src, &finder->stats.bytesskipped) ||
+      !hs_finder_checkpoint_read_value(src, &finder->stats.bytesoutput) ||
+      !hs_finder_checkpoint_read_value(src, &values[0]) ||
+      !hs_finder_checkpoint_read_value(src, &finder->stats.scantime) ||
+      !hs_finder_checkpoint_read_value(src, &finder->stats.callbacktime))
+    return 1;
+  finder->stats.peakbuffersize = (size_t)values[0];
+  hs_finder_update_buffer_stats(finder);
+  //statistics for each pattern id (only if profiling is still enabled)
+  if (!hs_finder_checkpoint_read_value(src, &len))
+    return 1;
+  for (i = 0; i < len; i++) {
+    if (!hs_finder_checkpoint_read_value(src, &values[0]) || !hs_finder_checkpoint_read_value(src, &values[1]) || !hs_finder_checkpoint_read_value(src, &values[2]) || !hs_finder_checkpoint_read_value(src, &values[3]))
+      return 1;
+    if (finder->profile && (profile = hs_finder_find_profile(finder, (unsigned int)values[0])) != NULL) {
+      profile->matches = values[1];
+      profile->callbacktime = values[2];
+      profile->retainedbytes = values[3];
+    }
+  }
+  return 0;
+}
+
+DLL_EXPORT_HS_FINDER hs_error_t hs_finder_load_checkpoint (struct hs_finder* finder, const char* filename, unsigned long long* inputpos, void* appdata, size_t appdatalen)
+{
+  FILE* src;
+  char signature[8];
+  unsigned long long len;
+  unsigned long long instances;
+  struct hs_finder* current;
+  int result;
+  //all search instances must have been opened and none can be running in its own thread
+  for (current = finder; current; current = current->next) {
+    if (current->threadrunning || (!current->stream && !current->suspendedstream))
+      return HS_INVALID;
+  }
+  if ((src = fopen(filename, "rb")) == NULL) {
+    fprintf(stderr, "ERROR: Unable to open checkpoint file: %s\n", filename);
+    return HS_INVALID;
+  }
+  result = (
+    hs_finder_checkpoint_read(src, signature, 8) &&
+    memcmp(signature, HS_FINDER_CHECKPOINT_SIGNATURE, 8) == 0 &&
+    hs_finder_checkpoint_read_value(src, inputpos) &&
+    hs_finder_checkpoint_read_value(src, &len) &&
+    len == appdatalen &&
+    hs_finder_checkpoint_read(src, appdata, appdatalen) &&
+    hs_finder_checkpoint_read_value(src, &instances)
+  );
+  for (current = finder; result && current; current = current->next)
+    result = (instances-- > 0 && hs_finder_load_instance_checkpoint(current, src) == 0);
+  result = result && (instances == 0);
+  fclose(src);
+  if (!result) {
+    fprintf(stderr, "ERROR: Checkpoint file is invalid or was not saved with the same search instances: %s\n", filename);
+    return HS_INVALID;
+  }
+  return HS_SUCCESS;
+}
+
+//scan complete data with block mode database (single segment) or vectored mode database of search instance
+static hs_error_t hs_finder_scan_block (struct hs_finder* finder, const struct hs_finder_iovec* iov, size_t iovcnt, int vectored)
+{
+  size_t i;
+  hs_scratch_t* scratch;
+  unsigned long long timer;
+  const char* stackdata[HS_SCAN_VECTOR_STACK_SIZE];
+  unsigned int stacklengths[HS_SCAN_VECTOR_STACK_SIZE];
+  const char** data = stackdata;
+  unsigned int* lengths = stacklengths;
+  hs_error_t status = HS_SUCCESS;
+  struct hs_finder_database* db = (vectored ? &finder->patterns->vectored : &finder->patterns->block);
+  if (iovcnt > HS_SCAN_VECTOR_STACK_SIZE) {
+    if (iovcnt > UINT_MAX) {
+      fprintf(stderr, "ERROR: Too many data segments for hs_scan_vector()\n");
+      return HS_INVALID;
+    }
+    data = (const char**)malloc(iovcnt * sizeof(const char*));
+    lengths = (unsigned int*)malloc(iovcnt * sizeof(unsigned int));
+    if (!data || !lengths)
+      status = HS_NOMEM;
+  }
+  for (i = 0; i < iovcnt && status == HS_SUCCESS; i++) {
+    if (iov[i].datalen > UINT_MAX) {
+      fprintf(stderr, "ERROR: Data too large for hs_scan()\n");
+      status = HS_INVALID;
+    }
+    data[i] = (iov[i].data ? iov[i].data : "");
+    lengths[i] = (unsigned int)iov[i].datalen;
+    finder->stats.bytesscanned += iov[i].datalen;
+  }
+  if (status == HS_SUCCESS) {
+    if ((scratch = hyperscan_scratch_pool_acquire(db->scratchpool)) == NULL) {
+      fprintf(stderr, "ERROR: Unable to allocate scratch space\n");
+      status = HS_NOMEM;
+    } else {
+      timer = hs_finder_start_scan_timer(finder);
+      if (vectored) {
+        if ((status = hs_scan_vector(db->database, data, lengths, (unsigned int)iovcnt, 0, scratch, hs_finder_get_match_handler(finder), finder)) != HS_SUCCESS)
+          fprintf(stderr, "ERROR %i in hs_scan_vector()\n", (int)status);
+      } else {
+        if ((status = hs_scan(db->database, (iovcnt > 0 ? data[0] : ""), (iovcnt > 0 ? lengths[0] : 0), 0, scratch, hs_finder_get_match_handler(finder), finder)) != HS_SUCCESS)
+          fprintf(stderr, "ERROR %i in hs_scan()\n", (int)status);
+      }
+      hs_finder_stop_scan_timer(finder, timer);
+      hyperscan_scratch_pool_release(db->scratchpool, scratch);
+    }
+  }
+  if (data != stackdata) {
+    free(data);
+    free(lengths);
+  }
+  return status;
+}
+
+static hs_error_t hs_finder_process_block_instances (struct hs_finder* finder, const struct hs_finder_iovec* iov, size_t iovcnt, int vectored, search_data_buffer_output_fn outputfn, void* callbackdata, int scanonly)
+{
+  size_t i;
+  hs_error_t status;
+  hs_error_t result = HS_SUCCESS;
+  struct hs_finder* current;
+  hs_finder_remove_empty_instance(finder);
+  //compile expressions in block or vectored mode (or load them from cache)
+  if ((status = hs_finder_prepare_databases(finder, (vectored ? HS_MODE_VECTORED : HS_MODE_BLOCK))) != HS_SUCCESS)
+    return status;
+  //set output function (collect output in buffer of next instance if not last in chain, otherwise set final output function)
+  for (current = finder; current; current = current->next) {
+    current->scanonly = scanonly;
+    deinitialize_output_buffer(current->outputbuffer);
+    current->outputbuffer = NULL;
+    if (scanonly) {
+      current->outputfn = NULL;
+      current->outputcallbackdata = NULL;
+    } else if (current->next) {
+      current->outputfn = hs_finder_output_to_buffer;
+      current->outputcallbackdata = current->next->searchdatabuffer;
+    } else if (hs_finder_set_final_output(current, outputfn, NULL, callbackdata) != 0) {
+      return HS_NOMEM;
+    }
+    reset_search_data_buffer(current->searchdatabuffer);
+    if (hs_finder_reset_replacements(current) != 0 || hs_finder_init_profile(current) != 0)
+      return HS_NOMEM;
+    memset(&current->stats, 0, sizeof(current->stats));
+  }
+  //the first instance uses the data of the caller without copying it
+  if (!scanonly) {
+    for (i = 0; i < iovcnt; i++)
+      search_data_buffer_add_external(finder->searchdatabuffer, iov[i].data, iov[i].datalen);
+  }
+  for (current = finder; current; current = current->next) {
+    //scan all data at once (the other instances search the output of the previous instance)
+    hs_finder_update_buffer_stats(current);
+    if (!scanonly && current != finder) {
+      struct hs_finder_iovec buffered;
+      buffered.datalen = search_data_buffer_get_len(current->searchdatabuffer);
+      buffered.data = search_data_buffer_get_at_pos(current->searchdatabuffer, 0);
+      status = hs_finder_scan_block(current, &buffered, 1, vectored);
+    } else {
+      status = hs_finder_scan_block(current, iov, iovcnt, vectored);
+    }
+    if (status != HS_SUCCESS && result == HS_SUCCESS)
+      result = status;
+    hs_finder_resolve_replacements(current, ULLONG_MAX);
+    hs_finder_flush_remaining(current);
+    if (current->outputbuffer)
+      output_buffer_flush(current->outputbuffer);
+  }
+  return result;
+}
+
+DLL_EXPORT_HS_FINDER hs_error_t hs_finder_process_block (struct hs_finder* finder, const char* data, size_t datalen, hs_finder_output_fn outputfn, void* callbackdata)
+{
+  struct hs_finder_iovec iov;
+  iov.data = data;
+  iov.datalen = datalen;
+  return hs_finder_process_block_instances(finder, &iov, 1, 0, outputfn, callbackdata, 0);
+}
+
+DLL_EXPORT_HS_FINDER hs_error_t hs_finder_process_block_scan_only (struct hs_finder* finder, const char* data, size_t datalen)
+{
+  struct hs_finder_iovec iov;
+  iov.data = data;
+  iov.datalen = datalen;
+  return hs_finder_process_block_instances(finder, &iov, 1, 0, NULL, NULL, 1);
+}
+
+DLL_EXPORT_HS_FINDER hs_error_t hs_finder_process_block_iov (struct hs_finder* finder, const struct hs_finder_iovec* iov, size_t iovcnt, hs_finder_output_fn outputfn, void* callbackdata)
+{
+  return hs_finder_process_block_instances(finder, iov, iovcnt, 1, outputfn, callbackdata, 0);
+}
+
+DLL_EXPORT_HS_FINDER hs_error_t hs_finder_process_block_iov_scan_only (struct hs_finder* finder, const struct hs_finder_iovec* iov, size_t iovcnt)
+{
+  return hs_finder_process_block_instances(finder, iov, iovcnt, 1, NULL, NULL, 1);
+}
+
+DLL_EXPORT_HS_FINDER size_t hs_finder_get_pos (struct hs_finder* finder)
+{
+  return search_data_buffer_get_pos(finder->searchdatabuffer);
+}
+
+DLL_EXPORT_HS_FINDER const char* hs_finder_get_buf_at_pos (struct hs_finder* finder, size_t pos)
+{
+  //buffered data may be moved to make it contiguous
+  if (finder->outputbuffer)
+    output_buffer_detach(finder->outputbuffer);
+  return search_data_buffer_get_at_pos(finder->searchdatabuffer, pos);
+}
+
+DLL_EXPORT_HS_FINDER const char* hs_finder_get_buf_span (struct hs_finder* finder, size_t pos, size_t* len)
+{
+  return search_data_buffer_get_span_at_pos(finder->searchdatabuffer, pos, len);
+}
+
+DLL_EXPORT_HS_FINDER void* hs_finder_get_callbackdata (struct hs_finder* finder)
+{
+  return finder->matchcallbackdata;
+}
+
+DLL_EXPORT_HS_FINDER size_t hs_finder_flush (struct hs_finder* finder, size_t flushpos)
+{
+  return hs_finder_flush_data(finder, flushpos, 0);
+}
+
+DLL_EXPORT_HS_FINDER size_t hs_finder_skip (struct hs_finder* finder, size_t flushpos)
+{
+  return hs_finder_flush_data(finder, flushpos, 1);
+}
+
+DLL_EXPORT_HS_FINDER size_t hs_finder_output (struct hs_finder* finder, const char* data, size_t datalen)
+{
+  if (!finder->outputfn)
+    return 0;
+  finder->stats.bytesoutput += datalen;
+  //data may not remain available, so copy it into the output buffer
+  if (finder->outputbuffer)
+    return output_buffer_add_copy(finder->outputbuffer, data, datalen);
+  return (*finder->outputfn)(finder->outputcallbackdata, data, datalen);
+}
+
+
+//add size of compiled expressions and scratch space of compile mode to statistics
+static void hs_finder_get_database_stats (struct hs_finder_database* db, struct hs_finder_stats* stats)
+{
+  size_t size;
+  if (db->database) {
+    if (hs_database_size(db->database, &size) == HS_SUCCESS)
+      stats->databasesize += size;
+    if (db->scratchpool)
+      stats->scratchsize += hyperscan_scratch_pool_get_size(db->scratchpool);
+  }
+}
+
+DLL_EXPORT_HS_FINDER size_t hs_finder_get_stats (struct hs_finder* finder, struct hs_finder_stats* stats, size_t maxstats)
+{
+  size_t size;
+  size_t count = 0;
+  struct hs_finder* current;
+  for (current = finder; current; current = current->next) {
+    if (count < maxstats) {
+      stats[count] = current->stats;
+      stats[count].buffersize = search_data_buffer_get_len(current->searchdatabuffer);
+      stats[count].databasesize = 0;
+      stats[count].streamsize = 0;
+      stats[count].scratchsize = 0;
+      pthread_mutex_lock(&current->patterns->lock);
+      hs_finder_get_database_stats(&current->patterns->stream, &stats[count]);
+      hs_finder_get_database_stats(&current->patterns->block, &stats[count]);
+      hs_finder_get_database_stats(&current->patterns->vectored, &stats[count]);
+      if (current->patterns->stream.database && hs_stream_size(current->patterns->stream.database, &size) == HS_SUCCESS)
+        stats[count].streamsize = size;
+      pthread_mutex_unlock(&current->patterns->lock);
+    }
+    count++;
+  }
+  return count;
+}
+
+DLL_EXPORT_HS_FINDER size_t hs_finder_get_profile (struct hs_finder* finder, struct hs_finder_pattern_profile* profile, size_t maxprofile)
+{
+  size_t i;
+  size_t instance = 0;
+  size_t count = 0;
+  struct hs_finder* current;
+  for (current = finder; current; current = current->next) {
+    for (i = 0; i < current->profilecount; i++) {
+      if (count < maxprofile) {
+        profile[count] = current->profile[i];
+        profile[count].instance = instance;
+      }
+      count++;
+    }
+    instance++;
+  }
+  return count;
+}
+
+//sort by time spent in match function, then by data retained, then by number of matches
+static int hs_finder_compare_profiles_by_cost (const void* a, const void* b)
+{
+  const struct hs_finder_pattern_profile* pa = (const struct hs_finder_pattern_profile*)a;
+  const struct hs_finder_pattern_profile* pb = (const struct hs_finder_pattern_profile*)b;
+  if (pa->callbacktime != pb->callbacktime)
+    return (pa->callbacktime > pb->callbacktime ? -1 : 1);
+  if (pa->retainedbytes != pb->retainedbytes)
+    return (pa->retainedbytes > pb->retainedbytes ? -1 : 1);
+  if (pa->matches != pb->matches)
+    return (pa->matches > pb->matches ? -1 : 1);
+  return hs_finder_compare_profiles_by_id(a, b);
+}
+
+DLL_EXPORT_HS_FINDER void hs_finder_write_profile (const struct hs_finder_pattern_profile* profile, size_t profilecount, size_t top, FILE* dst)
+{
+  size_t i;
+  char width[16];
+  char flags[4];
+  struct hs_finder_pattern_profile* sorted;
+  if ((sorted = (struct hs_finder_pattern_profile*)malloc((profilecount > 0 ? profilecount : 1) * sizeof(struct hs_finder_pattern_profile))) == NULL)
+    return;
+  memcpy(sorted, profile, profilecount * sizeof(struct hs_finder_pattern_profile));
+  qsort(sorted, profilecount, sizeof(struct hs_finder_pattern_profile), hs_finder_compare_profiles_by_cost);
+  if (top == 0 || top > profilecount)
+    top = profilecount;
+  fprintf(dst, "%8s %10s %12s %12s %14s %9s %9s %5s  %s\n", "instance", "id", "matches", "callback_ms", "retained", "min_width", "max_width", "flags", "expression");
+  for (i = 0; i < top; i++) {
+    if (sorted[i].maxwidth == UINT_MAX)
+      strcpy(width, "-");
+    else
+      sprintf(width, "%u", sorted[i].maxwidth);
+    //A = anchored, E = can match at end of data, O = only matches at end of data
+    sprintf(flags, "%s%s", (sorted[i].anchored ? "A" : ""), (sorted[i].matchesonlyateod ? "O" : (sorted[i].matchesateod ? "E" : "")));
+    fprintf(dst, "%8lu %10u %12llu %12.3f %14llu %9u %9s %5s  %s", (unsigned long)sorted[i].instance + 1, sorted[i].id, sorted[i].matches, (double)sorted[i].callbacktime / 1000000.0, sorted[i].retainedbytes, sorted[i].minwidth, width, (flags[0] ? flags : "-"), sorted[i].expression);
+    if (sorted[i].expressions > 1)
+      fprintf(dst, " (and %lu more)", (unsigned long)sorted[i].expressions - 1);
+    fprintf(dst, "\n");
+  }
+  free(sorted);
+}
@@ -0,0 +1,535 @@
+#include "hs_finder_input.h"
+#include "buffer_queue.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#ifdef _WIN32
+#include <io.h>
+#include <malloc.h>
+#else
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
+//size of the windows in which memory mapped files are returned (must be a multiple of the page size)
+#ifndef HS_FINDER_INPUT_WINDOW_SIZE
+#define HS_FINDER_INPUT_WINDOW_SIZE (64 * 1024 * 1024)
+#endif
+
+//size and alignment of the buffer for reading input that can't be memory mapped
+#ifndef HS_FINDER_INPUT_BUFFER_SIZE
+#define HS_FINDER_INPUT_BUFFER_SIZE (1024 * 1024)
+#endif
+#define HS_FINDER_INPUT_BUFFER_ALIGNMENT 4096
+
+//number of buffers filled by the read-ahead thread while the previous ones are being processed (0 to read without a separate thread)
+#ifndef HS_FINDER_INPUT_READ_AHEAD_BUFFERS
+#define HS_FINDER_INPUT_READ_AHEAD_BUFFERS 4
+#endif
+//compressed data is always decompressed in a separate thread
+#define HS_FINDER_INPUT_QUEUE_BUFFERS (HS_FINDER_INPUT_READ_AHEAD_BUFFERS > 0 ? HS_FINDER_INPUT_READ_AHEAD_BUFFERS : 2)
+
+//compression formats
+#define HS_FINDER_INPUT_PLAIN 0
+#define HS_FINDER_INPUT_GZIP  1
+#define HS_FINDER_INPUT_ZSTD  2
+
+//number of bytes needed to detect any of the compression formats
+#define HS_FINDER_INPUT_SIGNATURE_LEN 4
+
+#ifdef _WIN32
+#define HS_FINDER_INPUT_STAT struct _stati64
+#define hs_finder_input_fstat _fstati64
+#define hs_finder_input_lseek _lseeki64
+#else
+#define HS_FINDER_INPUT_STAT struct stat
+#define hs_finder_input_fstat fstat
+#define hs_finder_input_lseek lseek
+#endif
+
+/* a memory mapped file is returned from map[mappos] up to map[maplen - 1] (map starts at a page boundary before the requested offset),
+   other input is read until remaining bytes have been read, by a read-ahead thread passing buffers through queue
+   (or in buffer if the data fits in one buffer or the thread can't be started),
+   compressed data is read from the memory map or in buffer and decompressed into the buffers of queue by the read-ahead thread
+   (pendinglen bytes in buffer were read before the compression was detected),
+   after skipping input partiallen bytes at partial are returned first
+*/
+struct hs_finder_input {
+  int fd;
+  int closefd;
+  unsigned long long size;
+  char* map;
+  size_t maplen;
+  size_t mappos;
+  size_t windowpos;
+  char* buffer;
+  unsigned long long remaining;
+  struct buffer_queue_struct* queue;
+  pthread_t thread;
+  int threadrunning;
+  int queuebufferinuse;
+  int decompress;
+  int compression;
+  size_t pendinglen;
+  const char* partial;
+  size_t partiallen;
+};
+
+//get compression format from the first bytes of the data
+static int hs_finder_input_detect_compression (const char* data, size_t datalen)
+{
+  const unsigned char* signature = (const unsigned char*)data;
+  if (datalen >= 2 && signature[0] == 0x1F && signature[1] == 0x8B) {
+#ifdef HAVE_ZLIB
+    return HS_FINDER_INPUT_GZIP;
+#else
+    fprintf(stderr, "WARNING: Input is gzip compressed, but gzip support is not available\n");
+#endif
+  } else if (datalen >= 4 && signature[0] == 0x28 && signature[1] == 0xB5 && signature[2] == 0x2F && signature[3] == 0xFD) {
+#ifdef HAVE_ZSTD
+    return HS_FINDER_INPUT_ZSTD;
+#else
+    fprintf(stderr, "WARNING: Input is zstd compressed, but zstd support is not available\n");
+#endif
+  }
+  return HS_FINDER_INPUT_PLAIN;
+}
+
+//get next chunk of data from memory map or read it in buffer
+static const char* hs_finder_input_read_raw (struct hs_finder_input* input, size_t* datalen)
+{
+  if (input->pendinglen > 0) {
+    *datalen = input->pendinglen;
+    input->pendinglen = 0;
+    return input->buffer;
+  }
+#ifndef _WIN32
+  if (input->map) {
+    size_t len;
+    size_t windowstart;
+    //pages of the previous window are no longer needed
+    if (input->mappos > input->windowpos) {
+      windowstart = input->windowpos - input->windowpos % HS_FINDER_INPUT_WINDOW_SIZE;
+      madvise(input->map + windowstart, input->mappos - windowstart, MADV_DONTNEED);
+    }
+    input->windowpos = input->mappos;
+    if (input->mappos >= input->maplen) {
+      *datalen = 0;
+      return NULL;
+    }
+    //end windows at multiples of the window size so the next window starts at a page boundary
+    if ((len = input->maplen - input->mappos) > HS_FINDER_INPUT_WINDOW_SIZE - input->mappos % HS_FINDER_INPUT_WINDOW_SIZE)
+      len = HS_FINDER_INPUT_WINDOW_SIZE - input->mappos % HS_FINDER_INPUT_WINDOW_SIZE;
+    *datalen = len;
+    input->mappos += len;
+    return input->map + input->windowpos;
+  }
+#endif
+  {
+    int n;
+    size_t len = HS_FINDER_INPUT_BUFFER_SIZE;
+    if (len > input->remaining)
+      len = (size_t)input->remaining;
+    if (len == 0) {
+      *datalen = 0;
+      return NULL;
+    }
+    while ((n = read(input->fd, input->buffer, len)) < 0 && errno == EINTR)
+      ;
+    if (n <= 0) {
+      if (n < 0)
+        fprintf(stderr, "ERROR: Unable to read input data\n");
+      *datalen = 0;
+      return NULL;
+    }
+    input->remaining -= n;
+    *datalen = (size_t)n;
+    return input->buffer;
+  }
+}
+
+#ifdef HAVE_ZLIB
+//decompress gzip data (including multiple concatenated members) into the buffers of the queue
+static void hs_finder_input_decompress_gzip (struct hs_finder_input* input)
+{
+  int status;
+  z_stream strm;
+  const char* data;
+  size_t datalen;
+  char* out = NULL;
+  size_t outlen = 0;
+  int outputfull = 0;
+  int complete = 1;
+  memset(&strm, 0, sizeof(strm));
+  if (inflateInit2(&strm, 15 + 16) != Z_OK) {
+    fprintf(stderr, "ERROR: Unable to initialize gzip decompression\n");
+    return;
+  }
+  while (1) {
+    //only get more compressed data when all decompressed data was returned, pass on what was decompressed so far first
+    if (strm.avail_in == 0 && !outputfull) {
+      if (out && (char*)strm.next_out > out) {
+        buffer_queue_commit_write(input->queue, (size_t)((char*)strm.next_out - out));
+        out = NULL;
+      }
+      if ((data = hs_finder_input_read_raw(input, &datalen)) == NULL) {
+        if (!complete)
+          fprintf(stderr, "ERROR: Incomplete gzip compressed input data\n");
+        break;
+      }
+      strm.next_in = (Bytef*)data;
+      strm.avail_in = (uInt)datalen;
+    }
+    if (!out) {
+      if ((out = buffer_queue_get_write_buffer(input->queue, &outlen)) == NULL)
+        break;
+      strm.next_out = (Bytef*)out;
+      strm.avail_out = (uInt)outlen;
+    }
+    complete = 0;
+    if ((status = inflate(&strm, Z_NO_FLUSH)) == Z_STREAM_END) {
+      inflateReset(&strm);
+      complete = 1;
+    } else if (status != Z_OK && status != Z_BUF_ERROR) {
+      fprintf(stderr, "ERROR: Invalid gzip compressed input data\n");
+      break;
+    }
+    if ((outputfull = (strm.avail_out == 0)) != 0) {
+      buffer_queue_commit_write(input->queue, outlen);
+      out = NULL;
+    }
+  }
+  if (out)
+    buffer_queue_commit_write(input->queue, (size_t)((char*)strm.next_out - out));
+  inflateEnd(&strm);
+}
+#endif
+
+#ifdef HAVE_ZSTD
+//decompress zstd data (including multiple concatenated frames) into the buffers of the queue
+static void hs_finder_input_decompress_zstd (struct hs_finder_input* input)
+{
+  size_t status = 0;
+  ZSTD_DStream* dstream;
+  ZSTD_inBuffer in = {NULL, 0, 0};
+  ZSTD_outBuffer out = {NULL, 0, 0};
+  const char* data;
+  size_t datalen;
+  int outputfull = 0;
+  if ((dstream = ZSTD_createDStream()) == NULL || ZSTD_isError(ZSTD_initDStream(dstream))) {
+    fprintf(stderr, "ERROR: Unable to initialize zstd decompression\n");
+    ZSTD_freeDStream(dstream);
+    return;
+  }
+  while (1) {
+    //only get more compressed data when all decompressed data was returned, pass on what was decompressed so far first
+    if (in.pos == in.size && !outputfull) {
+      if (out.dst && out.pos > 0) {
+        buffer_queue_commit_write(input->queue, out.pos);
+        out.dst = NULL;
+      }
+      if ((data = hs_finder_input_read_raw(input, &datalen)) == NULL) {
+        //a frame is complete when the last call returned 0
+        if (status != 0)
+          fprintf(stderr, "ERROR: Incomplete zstd compressed input data\n");
+        break;
+      }
+      in.src = data;
+      in.size = datalen;
+      in.pos = 0;
+    }
+    if (!out.dst) {
+      if ((out.dst = buffer_queue_get_write_buffer(input->queue, &out.size)) == NULL)
+        break;
+      out.pos = 0;
+    }
+    if (ZSTD_isError(status = ZSTD_decompressStream(dstream, &out, &in))) {
+      fprintf(stderr, "ERROR: Invalid zstd compressed input data: %s\n", ZSTD_getErrorName(status));
+      break;
+    }
+    if ((outputfull = (out.pos == out.size)) != 0) {
+      buffer_queue_commit_write(input->queue, out.pos);
+      out.dst = NULL;
+    }
+  }
+  if (out.dst)
+    buffer_queue_commit_write(input->queue, out.pos);
+  ZSTD_freeDStream(dstream);
+}
+#endif
+
+//read input in a separate thread, so reading overlaps with processing the data read before
+static void* hs_finder_input_read_ahead_thread (void* param)
+{
+  int n;
+  int m;
+  char* buf;
+  size_t len;
+  struct hs_finder_input* input = (struct hs_finder_input*)param;
+  while (input->compression == HS_FINDER_INPUT_PLAIN && input->remaining > 0 && (buf = buffer_queue_get_write_buffer(input->queue, &len)) != NULL) {
+    if (len > input->remaining)
+      len = (size_t)input->remaining;
+    while ((n = read(input->fd, buf, len)) < 0 && errno == EINTR)
+      ;
+    if (n <= 0) {
+      if (n < 0)
+        fprintf(stderr, "ERROR: Unable to read input data\n");
+      break;
+    }
+    //a pipe may return less than the signature of a compression format, so read until it is complete before detecting the format
+    while (input->decompress && (size_t)n < HS_FINDER_INPUT_SIGNATURE_LEN && (size_t)n < len) {
+      while ((m = read(input->fd, buf + n, len - n)) < 0 && errno == EINTR)
+        ;
+      if (m <= 0) {
+        if (m < 0)
+          fprintf(stderr, "ERROR: Unable to read input data\n");
+        break;
+      }
+      n += m;
+    }
+    input->remaining -= n;
+    //check if the data needs to be decompressed (keep what was read as the first compressed data)
+    if (input->decompress) {
+      input->decompress = 0;
+      if ((input->compression = hs_finder_input_detect_compression(buf, (size_t)n)) != HS_FINDER_INPUT_PLAIN) {
+        memcpy(input->buffer, buf, n);
+        input->pendinglen = (size_t)n;
+        break;
+      }
+    }
+    //pass on what was read right away, waiting for a full buffer would delay data arriving slowly through a pipe
+    buffer_queue_commit_write(input->queue, (size_t)n);
+  }
+#ifdef HAVE_ZLIB
+  if (input->compression == HS_FINDER_INPUT_GZIP)
+    hs_finder_input_decompress_gzip(input);
+#endif
+#ifdef HAVE_ZSTD
+  if (input->compression == HS_FINDER_INPUT_ZSTD)
+    hs_finder_input_decompress_zstd(input);
+#endif
+  buffer_queue_close(input->queue);
+  return NULL;
+}
+
+static char* hs_finder_input_allocate_buffer ()
+{
+  char* buffer;
+#ifdef _WIN32
+  buffer = (char*)_aligned_malloc(HS_FINDER_INPUT_BUFFER_SIZE, HS_FINDER_INPUT_BUFFER_ALIGNMENT);
+#else
+  if (posix_memalign((void**)&buffer, HS_FINDER_INPUT_BUFFER_ALIGNMENT, HS_FINDER_INPUT_BUFFER_SIZE) != 0)
+    buffer = NULL;
+#endif
+  return buffer;
+}
+
+static struct hs_finder_input* hs_finder_input_open_internal (const char* filename, unsigned long long offset, unsigned long long length, int decompress)
+{
+  struct hs_finder_input* result;
+  HS_FINDER_INPUT_STAT st;
+  int regular = 0;
+  int readahead;
+  if ((result = (struct hs_finder_input*)malloc(sizeof(struct hs_finder_input))) == NULL)
+    return NULL;
+  result->size = 0;
+  result->map = NULL;
+  result->maplen = 0;
+  result->mappos = 0;
+  result->windowpos = 0;
+  result->buffer = NULL;
+  result->remaining = length;
+  result->queue = NULL;
+  result->threadrunning = 0;
+  result->queuebufferinuse = 0;
+  result->decompress = decompress;
+  result->compression = HS_FINDER_INPUT_PLAIN;
+  result->pendinglen = 0;
+  result->partial = NULL;
+  result->partiallen = 0;
+  //open file (or use standard input)
+  if (filename) {
+    if ((result->fd = open(filename, O_RDONLY | O_BINARY)) < 0) {
+      free(result);
+      return NULL;
+    }
+    result->closefd = 1;
+  } else {
+    result->fd = fileno(stdin);
+    result->closefd = 0;
+#ifdef _WIN32
+    _setmode(result->fd, _O_BINARY);
+#endif
+  }
+  if (hs_finder_input_fstat(result->fd, &st) == 0 && S_ISREG(st.st_mode)) {
+    result->size = (unsigned long long)st.st_size;
+    regular = 1;
+    //limit requested range to file size
+    if (offset > result->size)
+      offset = result->size;
+    if (result->remaining > result->size - offset)
+      result->remaining = result->size - offset;
+#ifndef _WIN32
+    //map regular files in memory
+    if (result->remaining > 0) {
+      unsigned long long mapoffset = offset - offset % (unsigned long long)sysconf(_SC_PAGESIZE);
+      unsigned long long maplen = offset - mapoffset + result->remaining;
+      if (maplen <= (size_t)-1) {
+        if ((result->map = (char*)mmap(NULL, (size_t)maplen, PROT_READ, MAP_PRIVATE, result->fd, (off_t)mapoffset)) == MAP_FAILED) {
+          result->map = NULL;
+        } else {
+          result->maplen = (size_t)maplen;
+          result->mappos = (size_t)(offset - mapoffset);
+          result->windowpos = result->mappos;
+          madvise(result->map, result->maplen, MADV_SEQUENTIAL);
+        }
+      }
+    }
+#endif
+  }
+  if (!result->map && offset > 0 && hs_finder_input_lseek(result->fd, offset, SEEK_SET) < 0) {
+    hs_finder_input_close(result);
+    return NULL;
+  }
+  if (result->map) {
+    //memory mapped data only needs a separate thread if it is compressed
+    if (decompress)
+      result->compression = hs_finder_input_detect_compression(result->map + result->mappos, result->maplen - result->mappos);
+    result->decompress = 0;
+    readahead = (result->compression != HS_FINDER_INPUT_PLAIN);
+  } else {
+    //read ahead in a separate thread, unless all data fits in one buffer (compression is detected by the thread)
+    readahead = (decompress || (HS_FINDER_INPUT_READ_AHEAD_BUFFERS > 0 && (!regular || result->remaining > HS_FINDER_INPUT_BUFFER_SIZE)));
+    //allocate buffer for reading input without separate thread or for reading compressed data
+    if ((!readahead || decompress) && (result->buffer = hs_finder_input_allocate_buffer()) == NULL) {
+      hs_finder_input_close(result);
+      return NULL;
+    }
+  }
+  if (readahead) {
+    if ((result->queue = initialize_buffer_queue(HS_FINDER_INPUT_QUEUE_BUFFERS, HS_FINDER_INPUT_BUFFER_SIZE)) != NULL) {
+      if (pthread_create(&result->thread, NULL, hs_finder_input_read_ahead_thread, result) == 0) {
+        result->threadrunning = 1;
+        return result;
+      }
+      deinitialize_buffer_queue(result->queue);
+      result->queue = NULL;
+    }
+    //only uncompressed data can be read without separate thread
+    if (decompress || (!result->map && !result->buffer && (result->buffer = hs_finder_input_allocate_buffer()) == NULL)) {
+      hs_finder_input_close(result);
+      return NULL;
+    }
+  }
+  return result;
+}
+
+DLL_EXPORT_HS_FINDER struct hs_finder_input* hs_finder_input_open (const char* filename)
+{
+  return hs_finder_input_open_internal(filename, 0, (unsigned long long)-1, 0);
+}
+
+DLL_EXPORT_HS_FINDER struct hs_finder_input* hs_finder_input_open_decompress (const char* filename)
+{
+  return hs_finder_input_open_internal(filename, 0, (unsigned long long)-1, 1);
+}
+
+DLL_EXPORT_HS_FINDER struct hs_finder_input* hs_finder_input_open_range (const char* filename, unsigned long long offset, unsigned long long length)
+{
+  if (!filename)
+    return NULL;
+  return hs_finder_input_open_internal(filename, offset, length, 0);
+}
+
+DLL_EXPORT_HS_FINDER unsigned long long hs_finder_input_get_size (struct hs_finder_input* input)
+{
+  return input->size;
+}
+
+DLL_EXPORT_HS_FINDER const char* hs_finder_input_read (struct hs_finder_input* input, size_t* datalen)
+{
+  //rest of the data partially skipped by hs_finder_input_skip()
+  if (input->partiallen > 0) {
+    *datalen = input->partiallen;
+    input->partiallen = 0;
+    return input->partial;
+  }
+  if (input->queue) {
+    const char* data;
+    //the buffer returned before can be filled again
+    if (input->queuebufferinuse) {
+      buffer_queue_release(input->queue);
+      input->queuebufferinuse = 0;
+    }
+    if ((data = buffer_queue_read(input->queue, datalen)) != NULL)
+      input->queuebufferinuse = 1;
+    return data;
+  }
+  return hs_finder_input_read_raw(input, datalen);
+}
+
+DLL_EXPORT_HS_FINDER unsigned long long hs_finder_input_skip (struct hs_finder_input* input, unsigned long long length)
+{
+  const char* data;
+  size_t datalen;
+  unsigned long long skipped = 0;
+#ifndef _WIN32
+  //uncompressed memory mapped data doesn't need to be read
+  if (input->map && !input->queue && input->partiallen == 0) {
+    if (length > input->maplen - input->mappos)
+      length = input->maplen - input->mappos;
+    input->mappos += (size_t)length;
+    return length;
+  }
+#endif
+  //other input is read and discarded (including data that must be decompressed)
+  while (skipped < length && (data = hs_finder_input_read(input, &datalen)) != NULL) {
+    if (datalen > length - skipped) {
+      input->partial = data + (size_t)(length - skipped);
+      input->partiallen = datalen - (size_t)(length - skipped);
+      return length;
+    }
+    skipped += datalen;
+  }
+  return skipped;
+}
+
+DLL_EXPORT_HS_FINDER void hs_finder_input_close (struct hs_finder_input* input)
+{
+  if (input) {
+    if (input->threadrunning) {
+      //the read-ahead thread may be waiting for a buffer to become available if not all data was read
+      buffer_queue_cancel(input->queue);
+      pthread_join(input->thread, NULL);
+    }
+    deinitialize_buffer_queue(input->queue);
+#ifndef _WIN32
+    if (input->map)
+      munmap(input->map, input->maplen);
+#endif
+    if (input->buffer)
+#ifdef _WIN32
+      _aligned_free(input->buffer);
+#else
+      free(input->buffer);
+#endif
+    if (input->closefd)
+      close(input->fd);
+    free(input);
+  }
+}
@@ -0,0 +1,168 @@
+#include "hyperscan_db_cache.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#define HYPERSCAN_DB_CACHE_MAGIC "HSFDBC02"
+#define HYPERSCAN_DB_CACHE_MAGIC_LEN 8
+#define HYPERSCAN_DB_CACHE_HEADER_LEN (HYPERSCAN_DB_CACHE_MAGIC_LEN + 8 + 4)
+
+//FNV-1a 64-bit hash
+#define FNV1A_64_INIT 0xcbf29ce484222325ULL
+#define FNV1A_64_PRIME 0x100000001b3ULL
+
+static unsigned long long fnv1a_64 (unsigned long long hash, const void* data, size_t datalen)
+{
+  const unsigned char* p = (const unsigned char*)data;
+  while (datalen-- > 0) {
+    hash ^= *p++;
+    hash *= FNV1A_64_PRIME;
+  }
+  return hash;
+}
+
+static unsigned long long fnv1a_64_uint (unsigned long long hash, unsigned long long value)
+{
+  int i;
+  unsigned char buf[8];
+  for (i = 0; i < 8; i++)
+    buf[i] = (unsigned char)(value >> (i * 8));
+  return fnv1a_64(hash, buf, 8);
+}
+
+unsigned long long hyperscan_db_cache_key (struct hyperscan_expr_list_struct* exprlist, unsigned int mode, const hs_platform_info_t* platform, unsigned int flagsmask)
+{
+  size_t i;
+  size_t n = hyperscan_expr_list_count(exprlist);
+  const char* const* expressions = hyperscan_expr_list_get_expressions(exprlist);
+  const unsigned int* flags = hyperscan_expr_list_get_flags(exprlist);
+  const unsigned int* ids = hyperscan_expr_list_get_ids(exprlist);
+  const char* const* literals = hyperscan_expr_list_get_literals(exprlist);
+  const size_t* lengths = hyperscan_expr_list_get_lengths(exprlist);
+  const char* version = hs_version();
+  hs_platform_info_t host;
+  unsigned long long hash = FNV1A_64_INIT;
+  //include hyperscan version as serialized databases are tied to it
+  hash = fnv1a_64(hash, version, strlen(version) + 1);
+  hash = fnv1a_64_uint(hash, mode);
+  //a database compiled for the current host can't be used on a host with other CPU features
+  if (!platform && hs_populate_platform(&host) == HS_SUCCESS)
+    platform = &host;
+  if (platform) {
+    hash = fnv1a_64_uint(hash, 1);
+    hash = fnv1a_64_uint(hash, platform->tune);
+    hash = fnv1a_64_uint(hash, platform->cpu_features);
+  } else {
+    hash = fnv1a_64_uint(hash, 0);
+  }
+  hash = fnv1a_64_uint(hash, n);
+  //lists with only literal strings are compiled differently
+  hash = fnv1a_64_uint(hash, hyperscan_expr_list_count_literals(exprlist));
+  for (i = 0; i < n; i++) {
+    //literal strings can contain null characters, so include their length
+    if (lengths[i] > 0) {
+      hash = fnv1a_64_uint(hash, lengths[i]);
+      hash = fnv1a_64(hash, literals[i], lengths[i]);
+    } else {
+      hash = fnv1a_64(hash, expressions[i], strlen(expressions[i]) + 1);
+    }
+    hash = fnv1a_64_uint(hash, flags[i] & flagsmask);
+    hash = fnv1a_64_uint(hash, ids[i]);
+  }
+  return hash;
+}
+
+static char* get_cache_filename (const char* cachedir, unsigned long long key, const char* suffix)
+{
+  char* result;
+  size_t dirlen = strlen(cachedir);
+  size_t len = dirlen + 1 + 10 + 16 + 5 + (suffix ? strlen(suffix) : 0) + 1;
+  if ((result = (char*)malloc(len)) != NULL) {
+    snprintf(result, len, "%s%s" "hs_finder_%016llx.hsdb%s", cachedir, (dirlen > 0 && cachedir[dirlen - 1] != '/' && cachedir[dirlen - 1] != '\\' ? "/" : ""), key, (suffix ? suffix : ""));
+  }
+  return result;
+}
+
+hs_database_t* hyperscan_db_cache_load (const char* cachedir, unsigned long long key, unsigned int* maxmatchwidth)
+{
+  FILE* src;
+  char* filename;
+  char* data;
+  long datalen;
+  int i;
+  unsigned long long filekey;
+  hs_database_t* database = NULL;
+  if ((filename = get_cache_filename(cachedir, key, NULL)) == NULL)
+    return NULL;
+  src = fopen(filename, "rb");
+  free(filename);
+  if (!src)
+    return NULL;
+  //read entire file
+  data = NULL;
+  if (fseek(src, 0, SEEK_END) == 0 && (datalen = ftell(src)) > HYPERSCAN_DB_CACHE_HEADER_LEN && fseek(src, 0, SEEK_SET) == 0) {
+    if ((data = (char*)malloc(datalen)) != NULL && fread(data, 1, datalen, src) != (size_t)datalen) {
+      free(data);
+      data = NULL;
+    }
+  }
+  fclose(src);
+  if (!data)
+    return NULL;
+  //check header and deserialize
+  filekey = 0;
+  for (i = 0; i < 8; i++)
+    filekey |= (unsigned long long)(unsigned char)data[HYPERSCAN_DB_CACHE_MAGIC_LEN + i] << (i * 8);
+  if (memcmp(data, HYPERSCAN_DB_CACHE_MAGIC, HYPERSCAN_DB_CACHE_MAGIC_LEN) == 0 && filekey == key) {
+    if (hs_deserialize_database(data + HYPERSCAN_DB_CACHE_HEADER_LEN, datalen - HYPERSCAN_DB_CACHE_HEADER_LEN, &database) != HS_SUCCESS)
+      database = NULL;
+    *maxmatchwidth = 0;
+    for (i = 0; i < 4; i++)
+      *maxmatchwidth |= (unsigned int)(unsigned char)data[HYPERSCAN_DB_CACHE_MAGIC_LEN + 8 + i] << (i * 8);
+  }
+  free(data);
+  return database;
+}
+
+int hyperscan_db_cache_save (const char* cachedir, unsigned long long key, const hs_database_t* database, unsigned int maxmatchwidth)
+{
+  FILE* dst;
+  char* filename;
+  char* tmpfilename;
+  char* data;
+  size_t datalen;
+  int i;
+  unsigned char header[HYPERSCAN_DB_CACHE_HEADER_LEN];
+  int result = -1;
+  if (hs_serialize_database(database, &data, &datalen) != HS_SUCCESS)
+    return -1;
+  memcpy(header, HYPERSCAN_DB_CACHE_MAGIC, HYPERSCAN_DB_CACHE_MAGIC_LEN);
+  for (i = 0; i < 8; i++)
+    header[HYPERSCAN_DB_CACHE_MAGIC_LEN + i] = (unsigned char)(key >> (i * 8));
+  for (i = 0; i < 4; i++)
+    header[HYPERSCAN_DB_CACHE_MAGIC_LEN + 8 + i] = (unsigned char)(maxmatchwidth >> (i * 8));
+  filename = get_cache_filename(cachedir, key, NULL);
+  tmpfilename = get_cache_filename(cachedir, key, ".tmp");
+  if (filename && tmpfilename) {
+    //write to temporary file first and then rename, so other processes never see a partial file
+    if ((dst = fopen(tmpfilename, "wb")) != NULL) {
+      if (fwrite(header, 1, HYPERSCAN_DB_CACHE_HEADER_LEN, dst) == HYPERSCAN_DB_CACHE_HEADER_LEN && fwrite(data, 1, datalen, dst) == datalen)
+        result = 0;
+      if (fclose(dst) != 0)
+        result = -1;
+      if (result == 0) {
+#ifdef _WIN32
+        remove(filename);
+#endif
+        if (rename(tmpfilename, filename) != 0)
+          result = -1;
+      }
+      if (result != 0)
+        remove(tmpfilename);
+    }
+  }
+  free(filename);
+  free(tmpfilename);
+  free(data);
+  return result;
+}
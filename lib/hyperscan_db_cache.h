@@ -0,0 +1,27 @@
+#ifndef INCLUDED_HYPERSCAN_DB_CACHE_H
+#define INCLUDED_HYPERSCAN_DB_CACHE_H
+
+#include "hyperscan_expr_list.h"
+#include <stdlib.h>
+#include <hs/hs.h>
+
+/* C library for caching compiled hyperscan databases on disk */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//calculate cache key for list of expressions compiled with specified mode and platform (NULL for the current host, with the flags of all expressions masked with flagsmask)
+unsigned long long hyperscan_db_cache_key (struct hyperscan_expr_list_struct* exprlist, unsigned int mode, const hs_platform_info_t* platform, unsigned int flagsmask);
+
+//load database and maximum match width from cache directory (returns NULL if not in cache or if cached data is not usable)
+hs_database_t* hyperscan_db_cache_load (const char* cachedir, unsigned long long key, unsigned int* maxmatchwidth);
+
+//save database and maximum match width to cache directory (returns zero on success)
+int hyperscan_db_cache_save (const char* cachedir, unsigned long long key, const hs_database_t* database, unsigned int maxmatchwidth);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //INCLUDED_HYPERSCAN_DB_CACHE_H
@@ -1,12 +1,23 @@
 #include "hyperscan_expr_list.h"
 #include <stdlib.h>
 #include <string.h>
+#include <ctype.h>
 
+//minimum number of entries to allocate
+#define HYPERSCAN_EXPR_LIST_MIN_ALLOC 16
+
+/* literal strings are also kept as escaped regular expression (used when a list contains both),
+   literals[i] is NULL and lengths[i] is 0 for regular expressions
+*/
 struct hyperscan_expr_list_struct {
   size_t entries;
+  size_t alloc;
+  size_t literalcount;
   char** expressions;
   unsigned int* flags;
   unsigned int* ids;
+  char** literals;
+  size_t* lengths;
 };
 
 struct hyperscan_expr_list_struct* initialize_hyperscan_data ()
@@ -14,9 +25,13 @@ struct hyperscan_expr_list_struct* initialize_hyperscan_data ()
   struct hyperscan_expr_list_struct* result;
   if ((result = (struct hyperscan_expr_list_struct*)malloc(sizeof(struct hyperscan_expr_list_struct))) != NULL) {
     result->entries = 0;
+    result->alloc = 0;
+    result->literalcount = 0;
     result->expressions = NULL;
     result->flags = NULL;
     result->ids = NULL;
+    result->literals = NULL;
+    result->lengths = NULL;
   }
   return result;
 };
@@ -30,25 +45,114 @@ void deinitialize_hyperscan_data (struct hyperscan_expr_list_struct* searchdata)
         free(searchdata->expressions[i]);
       free(searchdata->expressions);
     }
-    if (searchdata->flags) {
-      free(searchdata->flags);
-    }
-    if (searchdata->ids) {
-      free(searchdata->ids);
+    if (searchdata->literals) {
+      for (i = 0; i < searchdata->entries; i++)
+        free(searchdata->literals[i]);
+      free(searchdata->literals);
     }
+    free(searchdata->flags);
+    free(searchdata->ids);
+    free(searchdata->lengths);
     free(searchdata);
   }
 }
 
+//make room for another entry (returns non-zero on error)
+static int hyperscan_expr_list_grow (struct hyperscan_expr_list_struct* searchdata)
+{
+  char** expressions;
+  unsigned int* flags;
+  unsigned int* ids;
+  char** literals;
+  size_t* lengths;
+  size_t alloc;
+  if (searchdata->entries < searchdata->alloc)
+    return 0;
+  //grow geometrically as lists of literal strings can have millions of entries
+  alloc = (searchdata->alloc < HYPERSCAN_EXPR_LIST_MIN_ALLOC ? HYPERSCAN_EXPR_LIST_MIN_ALLOC : searchdata->alloc * 2);
+  if ((expressions = (char**)realloc(searchdata->expressions, alloc * sizeof(char*))) == NULL)
+    return 1;
+  searchdata->expressions = expressions;
+  if ((flags = (unsigned int*)realloc(searchdata->flags, alloc * sizeof(unsigned int))) == NULL)
+    return 1;
+  searchdata->flags = flags;
+  if ((ids = (unsigned int*)realloc(searchdata->ids, alloc * sizeof(unsigned int))) == NULL)
+    return 1;
+  searchdata->ids = ids;
+  if ((literals = (char**)realloc(searchdata->literals, alloc * sizeof(char*))) == NULL)
+    return 1;
+  searchdata->literals = literals;
+  if ((lengths = (size_t*)realloc(searchdata->lengths, alloc * sizeof(size_t))) == NULL)
+    return 1;
+  searchdata->lengths = lengths;
+  searchdata->alloc = alloc;
+  return 0;
+}
+
 void hyperscan_expr_list_add (struct hyperscan_expr_list_struct* searchdata, char* expr, unsigned int flags, unsigned int id)
 {
-  size_t i = searchdata->entries++;
-  if ((searchdata->expressions = (char**)realloc(searchdata->expressions, searchdata->entries * sizeof(char*))) != NULL)
-    searchdata->expressions[i] = expr;
-  if ((searchdata->flags = (unsigned int*)realloc(searchdata->flags, searchdata->entries * sizeof(unsigned int))) != NULL)
-    searchdata->flags[i] = flags;
-  if ((searchdata->ids = (unsigned int*)realloc(searchdata->ids, searchdata->entries * sizeof(unsigned int))) != NULL)
-    searchdata->ids[i] = id;
+  size_t i;
+  if (!expr || hyperscan_expr_list_grow(searchdata) != 0) {
+    free(expr);
+    return;
+  }
+  i = searchdata->entries++;
+  searchdata->expressions[i] = expr;
+  searchdata->flags[i] = flags;
+  searchdata->ids[i] = id;
+  searchdata->literals[i] = NULL;
+  searchdata->lengths[i] = 0;
+}
+
+//get regular expression matching literal string (alphanumeric characters are kept, printable characters are preceded by a backslash, others are written as hexadecimal code)
+static char* hyperscan_expr_list_escape_literal (const char* literal, size_t literallen)
+{
+  size_t i;
+  char* result;
+  char* p;
+  unsigned char c;
+  static const char hexdigits[] = "0123456789ABCDEF";
+  if ((result = (char*)malloc(literallen * 4 + 1)) == NULL)
+    return NULL;
+  p = result;
+  for (i = 0; i < literallen; i++) {
+    c = (unsigned char)literal[i];
+    if (c < 0x80 && isalnum(c)) {
+      *p++ = (char)c;
+    } else if (c > 0x20 && c < 0x7F) {
+      *p++ = '\\';
+      *p++ = (char)c;
+    } else {
+      *p++ = '\\';
+      *p++ = 'x';
+      *p++ = hexdigits[c >> 4];
+      *p++ = hexdigits[c & 0x0F];
+    }
+  }
+  *p = 0;
+  return result;
+}
+
+void hyperscan_expr_list_add_literal (struct hyperscan_expr_list_struct* searchdata, char* literal, size_t literallen, unsigned int flags, unsigned int id)
+{
+  size_t i;
+  char* expr;
+  if (!literal || (expr = hyperscan_expr_list_escape_literal(literal, literallen)) == NULL) {
+    free(literal);
+    return;
+  }
+  if (hyperscan_expr_list_grow(searchdata) != 0) {
+    free(expr);
+    free(literal);
+    return;
+  }
+  i = searchdata->entries++;
+  searchdata->expressions[i] = expr;
+  searchdata->flags[i] = flags;
+  searchdata->ids[i] = id;
+  searchdata->literals[i] = literal;
+  searchdata->lengths[i] = literallen;
+  searchdata->literalcount++;
 }
 
 size_t hyperscan_expr_list_count (struct hyperscan_expr_list_struct* searchdata)
@@ -56,6 +160,11 @@ size_t hyperscan_expr_list_count (struct hyperscan_expr_list_struct* searchdata)
   return searchdata->entries;
 }
 
+size_t hyperscan_expr_list_count_literals (struct hyperscan_expr_list_struct* searchdata)
+{
+  return searchdata->literalcount;
+}
+
 const char* const* hyperscan_expr_list_get_expressions (struct hyperscan_expr_list_struct* searchdata)
 {
   return (const char* const*)searchdata->expressions;
@@ -71,3 +180,12 @@ const unsigned int* hyperscan_expr_list_get_ids (struct hyperscan_expr_list_stru
   return searchdata->ids;
 }
 
+const char* const* hyperscan_expr_list_get_literals (struct hyperscan_expr_list_struct* searchdata)
+{
+  return (const char* const*)searchdata->literals;
+}
+
+const size_t* hyperscan_expr_list_get_lengths (struct hyperscan_expr_list_struct* searchdata)
+{
+  return searchdata->lengths;
+}
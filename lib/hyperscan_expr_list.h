@@ -22,10 +22,16 @@ void deinitialize_hyperscan_data (struct hyperscan_expr_list_struct* searchdata)
 //add data
 void hyperscan_expr_list_add (struct hyperscan_expr_list_struct* searchdata, char* expr, unsigned int flags, unsigned int id);
 
+//add literal string (may contain null characters, takes ownership of literal)
+void hyperscan_expr_list_add_literal (struct hyperscan_expr_list_struct* searchdata, char* literal, size_t literallen, unsigned int flags, unsigned int id);
+
 //get number of entries
 size_t hyperscan_expr_list_count (struct hyperscan_expr_list_struct* searchdata);
 
-//get pointer to list of expressions
+//get number of entries that are literal strings
+size_t hyperscan_expr_list_count_literals (struct hyperscan_expr_list_struct* searchdata);
+
+//get pointer to list of expressions (literal strings are returned as escaped regular expression)
 const char* const* hyperscan_expr_list_get_expressions (struct hyperscan_expr_list_struct* searchdata);
 
 //get pointer to list of flags
@@ -34,6 +40,12 @@ const unsigned int* hyperscan_expr_list_get_flags (struct hyperscan_expr_list_st
 //get pointer to list of ids
 const unsigned int* hyperscan_expr_list_get_ids (struct hyperscan_expr_list_struct* searchdata);
 
+//get pointer to list of literal strings (NULL for regular expressions)
+const char* const* hyperscan_expr_list_get_literals (struct hyperscan_expr_list_struct* searchdata);
+
+//get pointer to list of lengths of literal strings (0 for regular expressions)
+const size_t* hyperscan_expr_list_get_lengths (struct hyperscan_expr_list_struct* searchdata);
+
 #ifdef __cplusplus
 }
 #endif
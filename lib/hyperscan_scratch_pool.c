@@ -0,0 +1,90 @@
+#include "hyperscan_scratch_pool.h"
+#include <stdlib.h>
+#include <pthread.h>
+
+/* scratch spaces not in use are kept in a stack, new scratch spaces are cloned from the first one
+   (cloning only uses the size information of the original, so it may be in use by another thread)
+*/
+struct hyperscan_scratch_pool_struct {
+  hs_scratch_t* prototype;
+  hs_scratch_t** available;
+  size_t availablelen;
+  size_t count;
+  pthread_mutex_t lock;
+};
+
+struct hyperscan_scratch_pool_struct* initialize_hyperscan_scratch_pool (const hs_database_t* database)
+{
+  struct hyperscan_scratch_pool_struct* result;
+  if ((result = (struct hyperscan_scratch_pool_struct*)malloc(sizeof(struct hyperscan_scratch_pool_struct))) != NULL) {
+    result->prototype = NULL;
+    if ((result->available = (hs_scratch_t**)malloc(sizeof(hs_scratch_t*))) == NULL || hs_alloc_scratch(database, &result->prototype) != HS_SUCCESS) {
+      free(result->available);
+      free(result);
+      return NULL;
+    }
+    result->available[0] = result->prototype;
+    result->availablelen = 1;
+    result->count = 1;
+    pthread_mutex_init(&result->lock, NULL);
+  }
+  return result;
+}
+
+void deinitialize_hyperscan_scratch_pool (struct hyperscan_scratch_pool_struct* pool)
+{
+  size_t i;
+  if (pool) {
+    for (i = 0; i < pool->availablelen; i++)
+      hs_free_scratch(pool->available[i]);
+    free(pool->available);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool);
+  }
+}
+
+hs_scratch_t* hyperscan_scratch_pool_acquire (struct hyperscan_scratch_pool_struct* pool)
+{
+  hs_scratch_t* result = NULL;
+  pthread_mutex_lock(&pool->lock);
+  if (pool->availablelen > 0) {
+    result = pool->available[--pool->availablelen];
+  } else {
+    hs_scratch_t** available;
+    //make sure the scratch space can be given back without allocating memory
+    if ((available = (hs_scratch_t**)realloc(pool->available, (pool->count + 1) * sizeof(hs_scratch_t*))) != NULL) {
+      pool->available = available;
+      if (hs_clone_scratch(pool->prototype, &result) == HS_SUCCESS)
+        pool->count++;
+      else
+        result = NULL;
+    }
+  }
+  pthread_mutex_unlock(&pool->lock);
+  return result;
+}
+
+void hyperscan_scratch_pool_release (struct hyperscan_scratch_pool_struct* pool, hs_scratch_t* scratch)
+{
+  pthread_mutex_lock(&pool->lock);
+  pool->available[pool->availablelen++] = scratch;
+  pthread_mutex_unlock(&pool->lock);
+}
+
+size_t hyperscan_scratch_pool_get_count (struct hyperscan_scratch_pool_struct* pool)
+{
+  return pool->count;
+}
+
+size_t hyperscan_scratch_pool_get_size (struct hyperscan_scratch_pool_struct* pool)
+{
+  size_t size;
+  size_t count;
+  //all scratch spaces are clones of the first one
+  if (hs_scratch_size(pool->prototype, &size) != HS_SUCCESS)
+    return 0;
+  pthread_mutex_lock(&pool->lock);
+  count = pool->count;
+  pthread_mutex_unlock(&pool->lock);
+  return size * count;
+}
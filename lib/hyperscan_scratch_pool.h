@@ -0,0 +1,38 @@
+#ifndef INCLUDED_HYPERSCAN_SCRATCH_POOL_H
+#define INCLUDED_HYPERSCAN_SCRATCH_POOL_H
+
+#include <stdlib.h>
+#include <hs/hs.h>
+
+/* C library for sharing hyperscan scratch space for a database between threads */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//data structure
+struct hyperscan_scratch_pool_struct;
+
+//initialize (allocates first scratch space for database, returns NULL on error)
+struct hyperscan_scratch_pool_struct* initialize_hyperscan_scratch_pool (const hs_database_t* database);
+
+//clean up (no scratch space may be in use)
+void deinitialize_hyperscan_scratch_pool (struct hyperscan_scratch_pool_struct* pool);
+
+//get scratch space not in use by another thread (cloned if needed, returns NULL on error)
+hs_scratch_t* hyperscan_scratch_pool_acquire (struct hyperscan_scratch_pool_struct* pool);
+
+//give scratch space back to pool
+void hyperscan_scratch_pool_release (struct hyperscan_scratch_pool_struct* pool, hs_scratch_t* scratch);
+
+//get number of scratch spaces allocated
+size_t hyperscan_scratch_pool_get_count (struct hyperscan_scratch_pool_struct* pool);
+
+//get total size in bytes of scratch spaces allocated
+size_t hyperscan_scratch_pool_get_size (struct hyperscan_scratch_pool_struct* pool);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //INCLUDED_HYPERSCAN_SCRATCH_POOL_H
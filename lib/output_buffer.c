@@ -0,0 +1,206 @@
+#include "output_buffer.h"
+#include <stdlib.h>
+#include <string.h>
+
+//maximum number of pieces passed on at once
+#ifndef OUTPUT_BUFFER_MAX_PIECES
+#define OUTPUT_BUFFER_MAX_PIECES 1024
+#endif
+
+//no offset in copied data (piece refers to data of caller)
+#define OUTPUT_BUFFER_NOT_COPIED ((size_t)-1)
+
+/* pieces[i] refers to data of the caller or, if copyoffsets[i] is not OUTPUT_BUFFER_NOT_COPIED, to copy[copyoffsets[i]]
+   (pointers to copied data are only filled in when passing data on, as copy may be reallocated while collecting)
+   without outputvfn all data is copied and passed on as one chunk
+*/
+struct output_buffer_struct {
+  size_t buffersize;
+  output_buffer_output_fn* outputfn;
+  output_buffer_outputv_fn* outputvfn;
+  void* callbackdata;
+  struct hs_finder_iovec* pieces;
+  size_t* copyoffsets;
+  size_t piececount;
+  size_t piecealloc;
+  char* copy;
+  size_t copylen;
+  size_t copyalloc;
+  size_t pendinglen;
+};
+
+struct output_buffer_struct* initialize_output_buffer (size_t buffersize, output_buffer_output_fn outputfn, output_buffer_outputv_fn outputvfn, void* callbackdata)
+{
+  struct output_buffer_struct* result;
+  if ((result = (struct output_buffer_struct*)malloc(sizeof(struct output_buffer_struct))) != NULL) {
+    result->buffersize = buffersize;
+    result->outputfn = outputfn;
+    result->outputvfn = outputvfn;
+    result->callbackdata = callbackdata;
+    result->pieces = NULL;
+    result->copyoffsets = NULL;
+    result->piececount = 0;
+    result->piecealloc = 0;
+    result->copy = NULL;
+    result->copylen = 0;
+    result->copyalloc = 0;
+    result->pendinglen = 0;
+  }
+  return result;
+}
+
+void deinitialize_output_buffer (struct output_buffer_struct* outputbuffer)
+{
+  if (outputbuffer) {
+    free(outputbuffer->pieces);
+    free(outputbuffer->copyoffsets);
+    free(outputbuffer->copy);
+    free(outputbuffer);
+  }
+}
+
+//append data to copied data (returns offset in copied data, or OUTPUT_BUFFER_NOT_COPIED on error)
+static size_t output_buffer_append_copy (struct output_buffer_struct* outputbuffer, const char* data, size_t datalen)
+{
+  size_t offset = outputbuffer->copylen;
+  if (outputbuffer->copylen + datalen > outputbuffer->copyalloc) {
+    char* newcopy;
+    size_t newcopyalloc = (outputbuffer->copyalloc > 0 ? outputbuffer->copyalloc * 2 : outputbuffer->buffersize);
+    if (newcopyalloc < outputbuffer->copylen + datalen)
+      newcopyalloc = outputbuffer->copylen + datalen;
+    if ((newcopy = (char*)realloc(outputbuffer->copy, newcopyalloc)) == NULL)
+      return OUTPUT_BUFFER_NOT_COPIED;
+    outputbuffer->copy = newcopy;
+    outputbuffer->copyalloc = newcopyalloc;
+  }
+  memcpy(outputbuffer->copy + outputbuffer->copylen, data, datalen);
+  outputbuffer->copylen += datalen;
+  return offset;
+}
+
+//add piece, merged with the previous one if they are adjacent (returns non-zero on error)
+static int output_buffer_add_piece (struct output_buffer_struct* outputbuffer, const char* data, size_t datalen, size_t copyoffset)
+{
+  size_t i = outputbuffer->piececount;
+  if (i > 0) {
+    if (copyoffset != OUTPUT_BUFFER_NOT_COPIED ?
+        outputbuffer->copyoffsets[i - 1] != OUTPUT_BUFFER_NOT_COPIED && outputbuffer->copyoffsets[i - 1] + outputbuffer->pieces[i - 1].datalen == copyoffset :
+        outputbuffer->copyoffsets[i - 1] == OUTPUT_BUFFER_NOT_COPIED && outputbuffer->pieces[i - 1].data + outputbuffer->pieces[i - 1].datalen == data) {
+      outputbuffer->pieces[i - 1].datalen += datalen;
+      return 0;
+    }
+  }
+  if (i == outputbuffer->piecealloc) {
+    struct hs_finder_iovec* newpieces;
+    size_t* newcopyoffsets;
+    size_t newpiecealloc = (outputbuffer->piecealloc > 0 ? outputbuffer->piecealloc * 2 : 16);
+    if ((newpieces = (struct hs_finder_iovec*)realloc(outputbuffer->pieces, newpiecealloc * sizeof(struct hs_finder_iovec))) == NULL)
+      return 1;
+    outputbuffer->pieces = newpieces;
+    if ((newcopyoffsets = (size_t*)realloc(outputbuffer->copyoffsets, newpiecealloc * sizeof(size_t))) == NULL)
+      return 1;
+    outputbuffer->copyoffsets = newcopyoffsets;
+    outputbuffer->piecealloc = newpiecealloc;
+  }
+  outputbuffer->pieces[i].data = data;
+  outputbuffer->pieces[i].datalen = datalen;
+  outputbuffer->copyoffsets[i] = copyoffset;
+  outputbuffer->piececount++;
+  return 0;
+}
+
+//pass data on when enough is collected
+static void output_buffer_check_full (struct output_buffer_struct* outputbuffer)
+{
+  if (outputbuffer->pendinglen >= outputbuffer->buffersize || outputbuffer->piececount >= OUTPUT_BUFFER_MAX_PIECES)
+    output_buffer_flush(outputbuffer);
+}
+
+size_t output_buffer_add_copy (struct output_buffer_struct* outputbuffer, const char* data, size_t datalen)
+{
+  size_t offset;
+  if (datalen == 0)
+    return 0;
+  if ((offset = output_buffer_append_copy(outputbuffer, data, datalen)) == OUTPUT_BUFFER_NOT_COPIED)
+    return 0;
+  if (outputbuffer->outputvfn && output_buffer_add_piece(outputbuffer, NULL, datalen, offset) != 0)
+    return 0;
+  outputbuffer->pendinglen += datalen;
+  output_buffer_check_full(outputbuffer);
+  return datalen;
+}
+
+size_t output_buffer_add_ref (struct output_buffer_struct* outputbuffer, const char* data, size_t datalen)
+{
+  if (!outputbuffer->outputvfn)
+    return output_buffer_add_copy(outputbuffer, data, datalen);
+  if (datalen == 0)
+    return 0;
+  if (output_buffer_add_piece(outputbuffer, data, datalen, OUTPUT_BUFFER_NOT_COPIED) != 0)
+    return 0;
+  outputbuffer->pendinglen += datalen;
+  output_buffer_check_full(outputbuffer);
+  return datalen;
+}
+
+void output_buffer_detach (struct output_buffer_struct* outputbuffer)
+{
+  size_t i;
+  size_t j;
+  size_t offset;
+  for (i = 0; i < outputbuffer->piececount; i++) {
+    if (outputbuffer->copyoffsets[i] == OUTPUT_BUFFER_NOT_COPIED) {
+      if ((offset = output_buffer_append_copy(outputbuffer, outputbuffer->pieces[i].data, outputbuffer->pieces[i].datalen)) == OUTPUT_BUFFER_NOT_COPIED) {
+        //pass data on if it can't be copied
+        output_buffer_flush(outputbuffer);
+        return;
+      }
+      outputbuffer->copyoffsets[i] = offset;
+    }
+  }
+  //merge pieces that are now adjacent in the copied data
+  for (i = 1, j = 0; i < outputbuffer->piececount; i++) {
+    if (outputbuffer->copyoffsets[j] + outputbuffer->pieces[j].datalen == outputbuffer->copyoffsets[i]) {
+      outputbuffer->pieces[j].datalen += outputbuffer->pieces[i].datalen;
+    } else {
+      j++;
+      outputbuffer->pieces[j] = outputbuffer->pieces[i];
+      outputbuffer->copyoffsets[j] = outputbuffer->copyoffsets[i];
+    }
+  }
+  if (outputbuffer->piececount > 0)
+    outputbuffer->piececount = j + 1;
+}
+
+void output_buffer_flush (struct output_buffer_struct* outputbuffer)
+{
+  size_t i;
+  if (outputbuffer->pendinglen == 0)
+    return;
+  if (outputbuffer->outputvfn) {
+    for (i = 0; i < outputbuffer->piececount; i++) {
+      if (outputbuffer->copyoffsets[i] != OUTPUT_BUFFER_NOT_COPIED)
+        outputbuffer->pieces[i].data = outputbuffer->copy + outputbuffer->copyoffsets[i];
+    }
+    (*outputbuffer->outputvfn)(outputbuffer->callbackdata, outputbuffer->pieces, outputbuffer->piececount);
+  } else {
+    (*outputbuffer->outputfn)(outputbuffer->callbackdata, outputbuffer->copy, outputbuffer->copylen);
+  }
+  outputbuffer->piececount = 0;
+  outputbuffer->copylen = 0;
+  outputbuffer->pendinglen = 0;
+}
+
+void output_buffer_shrink (struct output_buffer_struct* outputbuffer)
+{
+  if (outputbuffer->pendinglen > 0)
+    return;
+  free(outputbuffer->pieces);
+  free(outputbuffer->copyoffsets);
+  free(outputbuffer->copy);
+  outputbuffer->pieces = NULL;
+  outputbuffer->copyoffsets = NULL;
+  outputbuffer->piecealloc = 0;
+  outputbuffer->copy = NULL;
+  outputbuffer->copyalloc = 0;
+}
@@ -0,0 +1,45 @@
+#ifndef INCLUDED_OUTPUT_BUFFER_H
+#define INCLUDED_OUTPUT_BUFFER_H
+
+#include <stdlib.h>
+#include "hs_finder.h"
+
+/* C library for collecting small pieces of output data and passing them on in large chunks */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef size_t (output_buffer_output_fn) (void* callbackdata, const char* data, size_t datalen);
+
+typedef size_t (output_buffer_outputv_fn) (void* callbackdata, const struct hs_finder_iovec* iov, size_t iovcnt);
+
+//data structure
+struct output_buffer_struct;
+
+//initialize (output is passed on when at least buffersize bytes are collected, either as one chunk to outputfn or as list of pieces to outputvfn if not NULL)
+struct output_buffer_struct* initialize_output_buffer (size_t buffersize, output_buffer_output_fn outputfn, output_buffer_outputv_fn outputvfn, void* callbackdata);
+
+//clean up (without passing on remaining data)
+void deinitialize_output_buffer (struct output_buffer_struct* outputbuffer);
+
+//add data (copied)
+size_t output_buffer_add_copy (struct output_buffer_struct* outputbuffer, const char* data, size_t datalen);
+
+//add data without copying it if passed on as list of pieces (must remain valid until output_buffer_detach() or output_buffer_flush() is called)
+size_t output_buffer_add_ref (struct output_buffer_struct* outputbuffer, const char* data, size_t datalen);
+
+//copy data added with output_buffer_add_ref() that was not passed on yet
+void output_buffer_detach (struct output_buffer_struct* outputbuffer);
+
+//pass on all collected data
+void output_buffer_flush (struct output_buffer_struct* outputbuffer);
+
+//release memory used for collecting data (only if all data was passed on)
+void output_buffer_shrink (struct output_buffer_struct* outputbuffer);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //INCLUDED_OUTPUT_BUFFER_H
@@ -2,11 +2,36 @@
 #include <stdlib.h>
 #include <string.h>
 
+//minimum number of bytes to allocate for buffer
+#define SEARCH_DATA_BUFFER_MIN_ALLOC 4096
+
+//minimum number of external segments to allocate
+#define SEARCH_DATA_BUFFER_MIN_SEGMENTS 8
+
+struct search_data_buffer_segment {
+  const char* data;
+  size_t datalen;
+};
+
+/* data that has not been flushed yet is kept in data[datastart] to data[datastart + datalen - 1]
+   flushing only advances datastart, the space in front of it is reclaimed when new data is added
+   and the flushed part is at least as large as the part still in use, so every byte is moved at most a constant number of times
+   if segmentcount is not zero the data is owned by the caller instead and starts at segmentoffset in segments[segmentindex],
+   except for segments[0] if ownedsegment is set, which refers to data not flushed yet when the first external data was added
+   (data is not moved while it is used as segment)
+*/
 struct search_data_buffer_struct {
   char* data;
+  size_t datastart;
   size_t datalen;
   size_t dataalloclen;
   size_t diskpos;
+  struct search_data_buffer_segment* segments;
+  size_t segmentcount;
+  size_t segmentalloc;
+  size_t segmentindex;
+  size_t segmentoffset;
+  int ownedsegment;
 };
 
 struct search_data_buffer_struct* initialize_search_data_buffer ()
@@ -14,9 +39,16 @@ struct search_data_buffer_struct* initialize_search_data_buffer ()
   struct search_data_buffer_struct* result;
   if ((result = (struct search_data_buffer_struct*)malloc(sizeof(struct search_data_buffer_struct))) != NULL) {
     result->data = NULL;
+    result->datastart = 0;
     result->datalen = 0;
     result->dataalloclen = 0;
     result->diskpos = 0;
+    result->segments = NULL;
+    result->segmentcount = 0;
+    result->segmentalloc = 0;
+    result->segmentindex = 0;
+    result->segmentoffset = 0;
+    result->ownedsegment = 0;
   }
   return result;
 };
@@ -26,84 +58,224 @@ void deinitialize_search_data_buffer (struct search_data_buffer_struct* searchda
   if (searchdata) {
     if (searchdata->data)
       free(searchdata->data);
+    if (searchdata->segments)
+      free(searchdata->segments);
     free(searchdata);
   }
 };
 
 void reset_search_data_buffer (struct search_data_buffer_struct* searchdata)
 {
-  if (searchdata->data)
-    free(searchdata->data);
-  searchdata->data = NULL;
+  //keep allocated memory so it can be reused
+  searchdata->datastart = 0;
   searchdata->datalen = 0;
-  searchdata->dataalloclen = 0;
   searchdata->diskpos = 0;
+  searchdata->segmentcount = 0;
+  searchdata->segmentindex = 0;
+  searchdata->segmentoffset = 0;
+  searchdata->ownedsegment = 0;
+}
+
+static void search_data_buffer_add_owned (struct search_data_buffer_struct* searchdata, const char* data, size_t datalen)
+{
+  if (searchdata->datastart + searchdata->datalen + datalen > searchdata->dataalloclen) {
+    if (searchdata->datalen + datalen <= searchdata->dataalloclen && searchdata->datastart >= searchdata->datalen) {
+      //move data to front of buffer
+      memmove(searchdata->data, searchdata->data + searchdata->datastart, searchdata->datalen);
+    } else {
+      //grow buffer geometrically and only copy data not flushed yet
+      char* newdata;
+      size_t newalloclen = (searchdata->dataalloclen < SEARCH_DATA_BUFFER_MIN_ALLOC / 2 ? SEARCH_DATA_BUFFER_MIN_ALLOC : searchdata->dataalloclen * 2);
+      if (newalloclen < searchdata->datalen + datalen)
+        newalloclen = searchdata->datalen + datalen;
+      if ((newdata = (char*)malloc(newalloclen)) == NULL)
+        return;
+      if (searchdata->data) {
+        memcpy(newdata, searchdata->data + searchdata->datastart, searchdata->datalen);
+        free(searchdata->data);
+      }
+      searchdata->data = newdata;
+      searchdata->dataalloclen = newalloclen;
+    }
+    searchdata->datastart = 0;
+  }
+  memcpy(searchdata->data + searchdata->datastart + searchdata->datalen, data, datalen);
+  searchdata->datalen += datalen;
+}
+
+//copy data owned by caller that was not flushed yet
+static void search_data_buffer_internalize (struct search_data_buffer_struct* searchdata)
+{
+  size_t i = searchdata->segmentindex;
+  size_t segmentcount = searchdata->segmentcount;
+  size_t offset = searchdata->segmentoffset;
+  searchdata->segmentcount = 0;
+  searchdata->datastart = 0;
+  searchdata->datalen = 0;
+  //data of own buffer that was not flushed yet stays where it is
+  if (searchdata->ownedsegment && i == 0) {
+    searchdata->datastart = searchdata->segments[0].data + offset - searchdata->data;
+    searchdata->datalen = searchdata->segments[0].datalen - offset;
+    offset = 0;
+    i++;
+  }
+  searchdata->ownedsegment = 0;
+  for (; i < segmentcount; i++) {
+    search_data_buffer_add_owned(searchdata, searchdata->segments[i].data + offset, searchdata->segments[i].datalen - offset);
+    offset = 0;
+  }
+  searchdata->segmentindex = 0;
+  searchdata->segmentoffset = 0;
 }
 
 void search_data_buffer_add (struct search_data_buffer_struct* searchdata, const char* data, size_t datalen)
 {
-  if (searchdata->datalen + datalen > searchdata->dataalloclen) {
-    searchdata->dataalloclen = searchdata->datalen + datalen;
-    searchdata->data = (char*)realloc(searchdata->data, searchdata->dataalloclen);
+  if (searchdata->segmentcount > 0)
+    search_data_buffer_internalize(searchdata);
+  search_data_buffer_add_owned(searchdata, data, datalen);
+}
+
+//make sure there is room for 2 more segments (returns non-zero on error)
+static int search_data_buffer_grow_segments (struct search_data_buffer_struct* searchdata)
+{
+  if (searchdata->segmentcount + 2 > searchdata->segmentalloc) {
+    struct search_data_buffer_segment* newsegments;
+    size_t newsegmentalloc = (searchdata->segmentalloc < SEARCH_DATA_BUFFER_MIN_SEGMENTS ? SEARCH_DATA_BUFFER_MIN_SEGMENTS : searchdata->segmentalloc * 2);
+    if ((newsegments = (struct search_data_buffer_segment*)realloc(searchdata->segments, newsegmentalloc * sizeof(struct search_data_buffer_segment))) == NULL)
+      return 1;
+    searchdata->segments = newsegments;
+    searchdata->segmentalloc = newsegmentalloc;
   }
-  memcpy(searchdata->data + searchdata->datalen, data, datalen);
+  return 0;
+}
+
+void search_data_buffer_add_external (struct search_data_buffer_struct* searchdata, const char* data, size_t datalen)
+{
+  if (datalen == 0)
+    return;
+  if (search_data_buffer_grow_segments(searchdata) != 0) {
+    search_data_buffer_add(searchdata, data, datalen);
+    return;
+  }
+  if (searchdata->segmentcount == 0) {
+    searchdata->segmentindex = 0;
+    searchdata->segmentoffset = 0;
+    //use data the buffer already holds as first segment
+    if (searchdata->datalen > 0) {
+      searchdata->segments[0].data = searchdata->data + searchdata->datastart;
+      searchdata->segments[0].datalen = searchdata->datalen;
+      searchdata->segmentcount = 1;
+      searchdata->ownedsegment = 1;
+    }
+  }
+  searchdata->segments[searchdata->segmentcount].data = data;
+  searchdata->segments[searchdata->segmentcount].datalen = datalen;
+  searchdata->segmentcount++;
   searchdata->datalen += datalen;
 }
 
-size_t search_data_buffer_flush (struct search_data_buffer_struct* searchdata, size_t flushpos, FILE* dst)
+void search_data_buffer_detach (struct search_data_buffer_struct* searchdata)
+{
+  if (searchdata->segmentcount > 0)
+    search_data_buffer_internalize(searchdata);
+}
+
+void search_data_buffer_shrink (struct search_data_buffer_struct* searchdata)
+{
+  char* newdata;
+  if (searchdata->segmentcount > 0)
+    search_data_buffer_internalize(searchdata);
+  free(searchdata->segments);
+  searchdata->segments = NULL;
+  searchdata->segmentalloc = 0;
+  if (searchdata->datalen == 0) {
+    free(searchdata->data);
+    searchdata->data = NULL;
+    searchdata->dataalloclen = 0;
+    searchdata->datastart = 0;
+  } else if (searchdata->dataalloclen > searchdata->datalen && (newdata = (char*)malloc(searchdata->datalen)) != NULL) {
+    memcpy(newdata, searchdata->data + searchdata->datastart, searchdata->datalen);
+    free(searchdata->data);
+    searchdata->data = newdata;
+    searchdata->dataalloclen = searchdata->datalen;
+    searchdata->datastart = 0;
+  }
+}
+
+static void search_data_buffer_discard (struct search_data_buffer_struct* searchdata, size_t len)
+{
+  searchdata->diskpos += len;
+  if ((searchdata->datalen -= len) == 0) {
+    searchdata->datastart = 0;
+    searchdata->segmentcount = 0;
+    searchdata->segmentindex = 0;
+    searchdata->segmentoffset = 0;
+    searchdata->ownedsegment = 0;
+  } else if (searchdata->segmentcount > 0) {
+    searchdata->segmentoffset += len;
+    while (searchdata->segmentoffset >= searchdata->segments[searchdata->segmentindex].datalen) {
+      searchdata->segmentoffset -= searchdata->segments[searchdata->segmentindex].datalen;
+      searchdata->segmentindex++;
+    }
+  } else {
+    searchdata->datastart += len;
+  }
+}
+
+//pass data to output function (one call per external segment) and remove it from buffer
+static size_t search_data_buffer_output (struct search_data_buffer_struct* searchdata, size_t len, search_data_buffer_output_fn flushfn, void* callbackdata)
 {
   size_t result;
-  if (flushpos <= searchdata->diskpos)
-    return 0;
-  if (flushpos > searchdata->diskpos + searchdata->datalen)
-    flushpos = searchdata->diskpos + searchdata->datalen;
-  if (dst)
-    result = fwrite(searchdata->data, 1, flushpos - searchdata->diskpos, dst);
-  else
-    result = flushpos - searchdata->diskpos;
-  memmove(searchdata->data, searchdata->data + flushpos - searchdata->diskpos, searchdata->datalen -= flushpos - searchdata->diskpos);
-  searchdata->diskpos = flushpos;
+  if (!flushfn) {
+    result = len;
+  } else if (searchdata->segmentcount == 0) {
+    result = (*flushfn)(callbackdata, searchdata->data + searchdata->datastart, len);
+  } else {
+    size_t n;
+    size_t i = searchdata->segmentindex;
+    size_t offset = searchdata->segmentoffset;
+    size_t remaining = len;
+    result = 0;
+    while (remaining > 0) {
+      if ((n = searchdata->segments[i].datalen - offset) > remaining)
+        n = remaining;
+      result += (*flushfn)(callbackdata, searchdata->segments[i].data + offset, n);
+      remaining -= n;
+      offset = 0;
+      i++;
+    }
+  }
+  search_data_buffer_discard(searchdata, len);
   return result;
 }
 
+static size_t search_data_buffer_write_to_stream (void* callbackdata, const char* data, size_t datalen)
+{
+  return fwrite(data, 1, datalen, (FILE*)callbackdata);
+}
+
+size_t search_data_buffer_flush (struct search_data_buffer_struct* searchdata, size_t flushpos, FILE* dst)
+{
+  return search_data_buffer_flush_fn(searchdata, flushpos, (dst ? search_data_buffer_write_to_stream : NULL), dst);
+}
+
 size_t search_data_buffer_flush_fn (struct search_data_buffer_struct* searchdata, size_t flushpos, search_data_buffer_output_fn flushfn, void* callbackdata)
 {
-  size_t result;
   if (flushpos <= searchdata->diskpos)
     return 0;
   if (flushpos > searchdata->diskpos + searchdata->datalen)
     flushpos = searchdata->diskpos + searchdata->datalen;
-  if (flushfn)
-    result = (*flushfn)(callbackdata, searchdata->data, flushpos - searchdata->diskpos);
-  else
-    result = flushpos - searchdata->diskpos;
-  memmove(searchdata->data, searchdata->data + flushpos - searchdata->diskpos, searchdata->datalen -= flushpos - searchdata->diskpos);
-  searchdata->diskpos = flushpos;
-  return result;
+  return search_data_buffer_output(searchdata, flushpos - searchdata->diskpos, flushfn, callbackdata);
 }
 
 size_t search_data_buffer_flush_remaining (struct search_data_buffer_struct* searchdata, FILE* dst)
 {
-  size_t result;
-  if (dst)
-    result = fwrite(searchdata->data, 1, searchdata->datalen, dst);
-  else
-    result = searchdata->datalen;
-  searchdata->diskpos += searchdata->datalen;
-  searchdata->datalen = 0;
-  return result;
+  return search_data_buffer_output(searchdata, searchdata->datalen, (dst ? search_data_buffer_write_to_stream : NULL), dst);
 }
 
 size_t search_data_buffer_flush_remaining_fn (struct search_data_buffer_struct* searchdata, search_data_buffer_output_fn flushfn, void* callbackdata)
 {
-  size_t result;
-  if (flushfn)
-    result = (*flushfn)(callbackdata, searchdata->data, searchdata->datalen);
-  else
-    result = searchdata->datalen;
-  searchdata->diskpos += searchdata->datalen;
-  searchdata->datalen = 0;
-  return result;
+  return search_data_buffer_output(searchdata, searchdata->datalen, (searchdata->datalen > 0 ? flushfn : NULL), callbackdata);
 }
 
 size_t search_data_buffer_get_pos (struct search_data_buffer_struct* searchdata)
@@ -111,15 +283,56 @@ size_t search_data_buffer_get_pos (struct search_data_buffer_struct* searchdata)
   return searchdata->diskpos;
 }
 
+void search_data_buffer_set_pos (struct search_data_buffer_struct* searchdata, size_t pos)
+{
+  searchdata->diskpos = pos;
+}
+
 size_t search_data_buffer_get_len (struct search_data_buffer_struct* searchdata)
 {
   return searchdata->datalen;
 }
 
+//find external segment containing position (returns offset in segment)
+static size_t search_data_buffer_find_segment (struct search_data_buffer_struct* searchdata, size_t pos, size_t* segment)
+{
+  size_t offset = pos - searchdata->diskpos + searchdata->segmentoffset;
+  size_t i = searchdata->segmentindex;
+  while (offset >= searchdata->segments[i].datalen) {
+    offset -= searchdata->segments[i].datalen;
+    i++;
+  }
+  *segment = i;
+  return offset;
+}
+
 const char* search_data_buffer_get_at_pos (struct search_data_buffer_struct* searchdata, size_t pos)
 {
   if (pos < searchdata->diskpos || pos >= searchdata->diskpos + searchdata->datalen)
     return NULL;
-  return searchdata->data + (pos - searchdata->diskpos);
+  if (searchdata->segmentcount > 0) {
+    size_t segment;
+    size_t offset = search_data_buffer_find_segment(searchdata, pos, &segment);
+    //data up to the end is only contiguous in the last segment, otherwise copy it
+    if (segment == searchdata->segmentcount - 1)
+      return searchdata->segments[segment].data + offset;
+    search_data_buffer_internalize(searchdata);
+  }
+  return searchdata->data + searchdata->datastart + (pos - searchdata->diskpos);
 }
 
+const char* search_data_buffer_get_span_at_pos (struct search_data_buffer_struct* searchdata, size_t pos, size_t* len)
+{
+  if (pos < searchdata->diskpos || pos >= searchdata->diskpos + searchdata->datalen) {
+    *len = 0;
+    return NULL;
+  }
+  if (searchdata->segmentcount > 0) {
+    size_t segment;
+    size_t offset = search_data_buffer_find_segment(searchdata, pos, &segment);
+    *len = searchdata->segments[segment].datalen - offset;
+    return searchdata->segments[segment].data + offset;
+  }
+  *len = searchdata->diskpos + searchdata->datalen - pos;
+  return searchdata->data + searchdata->datastart + (pos - searchdata->diskpos);
+}
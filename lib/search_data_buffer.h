@@ -27,6 +27,15 @@ void reset_search_data_buffer (struct search_data_buffer_struct* searchdata);
 //add data
 void search_data_buffer_add (struct search_data_buffer_struct* searchdata, const char* data, size_t datalen);
 
+//add data owned by caller without copying it (must remain valid until it is flushed, search_data_buffer_detach is called or data is added with search_data_buffer_add)
+void search_data_buffer_add_external (struct search_data_buffer_struct* searchdata, const char* data, size_t datalen);
+
+//copy data owned by caller that was not flushed yet
+void search_data_buffer_detach (struct search_data_buffer_struct* searchdata);
+
+//release memory not needed for the data not flushed yet (data owned by caller is copied)
+void search_data_buffer_shrink (struct search_data_buffer_struct* searchdata);
+
 //flush data to stream
 size_t search_data_buffer_flush (struct search_data_buffer_struct* searchdata, size_t flushpos, FILE* dst);
 
@@ -42,12 +51,18 @@ size_t search_data_buffer_flush_remaining_fn (struct search_data_buffer_struct*
 //get number of bytes flushed
 size_t search_data_buffer_get_pos (struct search_data_buffer_struct* searchdata);
 
+//set number of bytes flushed (only when buffer is empty, to continue where a previous search stopped)
+void search_data_buffer_set_pos (struct search_data_buffer_struct* searchdata, size_t pos);
+
 //get number of bytes in buffer (not flushed yet)
 size_t search_data_buffer_get_len (struct search_data_buffer_struct* searchdata);
 
-//get pointer to buffer
+//get pointer to buffer (data added with search_data_buffer_add_external is copied if it is not contiguous up to the end)
 const char* search_data_buffer_get_at_pos (struct search_data_buffer_struct* searchdata, size_t pos);
 
+//get pointer to buffer and number of contiguous bytes available there (never copies data)
+const char* search_data_buffer_get_span_at_pos (struct search_data_buffer_struct* searchdata, size_t pos, size_t* len);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,471 @@
+#include "hs_finder.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <string.h>
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <time.h>
+#include <unistd.h>
+#ifdef __APPLE__
+#include <mach/mach.h>
+#endif
+#endif
+
+//maximum number of values for each swept setting
+#define MAX_SWEEP_VALUES 16
+
+//modes of searching
+#define MODE_STREAM 0
+#define MODE_BLOCK  1
+#define MODE_SCAN   2
+static const char* modenames[] = {"stream", "block", "scan", NULL};
+
+//output sinks
+#define SINK_NULL   0
+#define SINK_MEMORY 1
+#define SINK_FILE   2
+static const char* sinknames[] = {"null", "memory", "file", NULL};
+
+struct sweep_struct {
+  size_t values[MAX_SWEEP_VALUES];
+  size_t count;
+};
+
+struct memory_sink_struct {
+  char* data;
+  size_t datalen;
+  size_t dataalloc;
+};
+
+static double get_time ()
+{
+#ifdef _WIN32
+  LARGE_INTEGER frequency;
+  LARGE_INTEGER counter;
+  QueryPerformanceFrequency(&frequency);
+  QueryPerformanceCounter(&counter);
+  return (double)counter.QuadPart / (double)frequency.QuadPart;
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+#endif
+}
+
+//get current memory use of this process in KB (peak values can't be used as they only grow over all combinations)
+static unsigned long get_current_rss ()
+{
+#if defined(_WIN32)
+  PROCESS_MEMORY_COUNTERS pmc;
+  if (GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc)))
+    return (unsigned long)(pmc.WorkingSetSize / 1024);
+  return 0;
+#elif defined(__APPLE__)
+  struct mach_task_basic_info info;
+  mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+  if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, (task_info_t)&info, &count) == KERN_SUCCESS)
+    return (unsigned long)(info.resident_size / 1024);
+  return 0;
+#else
+  FILE* src;
+  unsigned long size;
+  unsigned long resident = 0;
+  if ((src = fopen("/proc/self/statm", "r")) != NULL) {
+    if (fscanf(src, "%lu %lu", &size, &resident) != 2)
+      resident = 0;
+    fclose(src);
+  }
+  return (unsigned long)((unsigned long long)resident * sysconf(_SC_PAGESIZE) / 1024);
+#endif
+}
+
+static size_t output_to_memory (void* callbackdata, const char* data, size_t datalen)
+{
+  struct memory_sink_struct* sink = (struct memory_sink_struct*)callbackdata;
+  if (sink->datalen + datalen > sink->dataalloc) {
+    char* newdata;
+    size_t newdataalloc = (sink->dataalloc > 0 ? sink->dataalloc * 2 : 1024 * 1024);
+    if (newdataalloc < sink->datalen + datalen)
+      newdataalloc = sink->datalen + datalen;
+    if ((newdata = (char*)realloc(sink->data, newdataalloc)) == NULL)
+      return 0;
+    sink->data = newdata;
+    sink->dataalloc = newdataalloc;
+  }
+  memcpy(sink->data + sink->datalen, data, datalen);
+  sink->datalen += datalen;
+  return datalen;
+}
+
+//maximum length of pattern text including terminating zero
+#define PATTERN_BUFFER_SIZE 48
+
+//generate pattern text for pattern number of layer (contains digits, which don't occur in the generated data)
+static void get_pattern (char* buf, size_t layer, size_t pattern)
+{
+  snprintf(buf, PATTERN_BUFFER_SIZE, "q%lux%05luz", (unsigned long)layer, (unsigned long)pattern);
+}
+
+//simple pseudo random number generator, so the same data is generated every time
+static unsigned long long random_next (unsigned long long* state)
+{
+  *state ^= *state << 13;
+  *state ^= *state >> 7;
+  *state ^= *state << 17;
+  return *state;
+}
+
+//generate data consisting of lower case words with density matches of the first layer patterns per MB
+static char* generate_corpus (size_t corpuslen, size_t density, size_t patterns)
+{
+  size_t i;
+  size_t n;
+  size_t pos;
+  size_t len;
+  char pattern[PATTERN_BUFFER_SIZE];
+  char* result;
+  unsigned long long state = 0x2545F4914F6CDD1DULL;
+  if ((result = (char*)malloc(corpuslen)) == NULL)
+    return NULL;
+  for (i = 0; i < corpuslen; i++)
+    result[i] = (random_next(&state) % 7 == 0 ? ' ' : 'a' + (char)(random_next(&state) % 26));
+  //insert matches at evenly spaced positions
+  n = (size_t)((unsigned long long)corpuslen * density / (1024 * 1024));
+  for (i = 0; i < n; i++) {
+    get_pattern(pattern, 0, random_next(&state) % patterns);
+    len = strlen(pattern);
+    pos = (size_t)((unsigned long long)i * corpuslen / n);
+    if (pos + len <= corpuslen)
+      memcpy(result + pos, pattern, len);
+  }
+  return result;
+}
+
+//create search instances, each replacing the patterns of its layer with the patterns of the next layer
+static struct hs_finder* create_finder (size_t layers, size_t patterns, const char* cachedir)
+{
+  size_t i;
+  size_t j;
+  char pattern[PATTERN_BUFFER_SIZE];
+  char replacement[PATTERN_BUFFER_SIZE];
+  struct hs_finder* finder;
+  if ((finder = hs_finder_initialize(NULL, NULL)) == NULL)
+    return NULL;
+  hs_finder_set_cache_dir(finder, cachedir);
+  for (i = 0; i < layers; i++) {
+    if (i > 0)
+      hs_finder_add_instance(finder, NULL, NULL);
+    for (j = 0; j < patterns; j++) {
+      get_pattern(pattern, i, j);
+      get_pattern(replacement, i + 1, j);
+      hs_finder_add_expr(finder, pattern, HS_FLAG_SOM_LEFTMOST, (unsigned int)(i * patterns + j));
+      hs_finder_set_replacement(finder, (unsigned int)(i * patterns + j), replacement, strlen(replacement));
+    }
+  }
+  return finder;
+}
+
+//parse comma separated list of numbers
+static int parse_numbers (struct sweep_struct* sweep, const char* param)
+{
+  char* end;
+  sweep->count = 0;
+  while (*param) {
+    if (sweep->count >= MAX_SWEEP_VALUES)
+      return -1;
+    sweep->values[sweep->count++] = (size_t)strtoul(param, &end, 10);
+    if (end == param || (*end && *end != ','))
+      return -1;
+    param = (*end ? end + 1 : end);
+  }
+  return (sweep->count > 0 ? 0 : -1);
+}
+
+//parse comma separated list of names
+static int parse_names (struct sweep_struct* sweep, const char* param, const char** names)
+{
+  size_t i;
+  size_t len;
+  sweep->count = 0;
+  while (*param) {
+    len = strcspn(param, ",");
+    for (i = 0; names[i]; i++) {
+      if (strlen(names[i]) == len && strncmp(names[i], param, len) == 0)
+        break;
+    }
+    if (!names[i] || sweep->count >= MAX_SWEEP_VALUES)
+      return -1;
+    sweep->values[sweep->count++] = i;
+    param += len;
+    if (*param)
+      param++;
+  }
+  return (sweep->count > 0 ? 0 : -1);
+}
+
+void show_help()
+{
+  printf(
+    "Usage:  hs_finder_bench [-?|-h] [-s size] [-m densities] [-p counts] [-c sizes] [-l counts] [-o sinks] [-x modes] [-r runs] [-d dir] [-j]\n" \
+    "Parameters:\n" \
+    "  -? | -h     \tshow help\n" \
+    "  -s size     \tsize of generated data in MB (default: 64)\n" \
+    "  -m densities\tcomma separated list of number of matches per MB (default: 0,100,10000)\n" \
+    "  -p counts   \tcomma separated list of number of patterns per search instance (default: 1,100,1000)\n" \
+    "  -c sizes    \tcomma separated list of sizes of chunks passed to hs_finder_process() in bytes (default: 4096,65536,1048576)\n" \
+    "  -l counts   \tcomma separated list of number of search instances (default: 1,3)\n" \
+    "  -o sinks    \tcomma separated list of output sinks: null, memory, file (default: null,memory,file)\n" \
+    "  -x modes    \tcomma separated list of modes: stream, block, scan (default: stream,block,scan)\n" \
+    "  -r runs     \tnumber of runs for each combination, the fastest one is reported (default: 3)\n" \
+    "  -d dir      \tdirectory for caching compiled patterns\n" \
+    "  -j          \twrite results as JSON objects (one per line) instead of CSV\n" \
+    "Version: " HS_FINDER_VERSION_STRING "\n" \
+    "\n"
+  );
+}
+
+//get value of command line parameter (either following the flag or as next parameter)
+static const char* get_param (int argc, char** argv, int* i)
+{
+  if (argv[*i][2])
+    return argv[*i] + 2;
+  if (*i + 1 < argc && argv[*i + 1])
+    return argv[++*i];
+  return NULL;
+}
+
+//search data with one combination of settings (returns seconds spent processing or a negative value on error)
+static double run_benchmark (struct hs_finder* finder, const char* corpus, size_t corpuslen, size_t chunksize, int mode, int sink, struct memory_sink_struct* memorysink, FILE* filesink)
+{
+  size_t pos;
+  size_t len;
+  double starttime;
+  hs_error_t status = HS_SUCCESS;
+  hs_finder_output_fn outputfn = (sink == SINK_MEMORY ? output_to_memory : (sink == SINK_FILE ? hs_finder_output_to_stream : hs_finder_output_to_null));
+  void* callbackdata = (sink == SINK_MEMORY ? (void*)memorysink : (sink == SINK_FILE ? (void*)filesink : NULL));
+  memorysink->datalen = 0;
+  if (filesink)
+    rewind(filesink);
+  starttime = get_time();
+  if (mode == MODE_BLOCK) {
+    status = hs_finder_process_block(finder, corpus, corpuslen, outputfn, callbackdata);
+  } else {
+    if (mode == MODE_SCAN)
+      status = hs_finder_open_scan_only(finder);
+    else
+      status = hs_finder_open(finder, outputfn, callbackdata);
+    if (status != HS_SUCCESS)
+      return -1;
+    for (pos = 0; pos < corpuslen && status == HS_SUCCESS; pos += len) {
+      len = (corpuslen - pos < chunksize ? corpuslen - pos : chunksize);
+      status = hs_finder_process(finder, corpus + pos, len);
+    }
+    if (hs_finder_close(finder) != HS_SUCCESS)
+      status = HS_UNKNOWN_ERROR;
+  }
+  if (filesink)
+    fflush(filesink);
+  if (status != HS_SUCCESS)
+    return -1;
+  return get_time() - starttime;
+}
+
+int main (int argc, char** argv)
+{
+  size_t corpussize = 64;
+  size_t runs = 3;
+  const char* cachedir = NULL;
+  int json = 0;
+  struct sweep_struct densities = {{0, 100, 10000}, 3};
+  struct sweep_struct patterncounts = {{1, 100, 1000}, 3};
+  struct sweep_struct chunksizes = {{4096, 65536, 1048576}, 3};
+  struct sweep_struct layercounts = {{1, 3}, 2};
+  struct sweep_struct sinks = {{SINK_NULL, SINK_MEMORY, SINK_FILE}, 3};
+  struct sweep_struct modes = {{MODE_STREAM, MODE_BLOCK, MODE_SCAN}, 3};
+  struct memory_sink_struct memorysink = {NULL, 0, 0};
+  FILE* filesink = NULL;
+  char* corpus;
+  size_t corpuslen;
+  size_t idensity, ipatterns, ilayers, imode, ichunk, isink, irun, id;
+  //process command line parameters
+  {
+    int i = 0;
+    const char* param;
+    int paramerror = 0;
+    while (!paramerror && ++i < argc) {
+      if (argv[i][0] != '-') {
+        paramerror++;
+        break;
+      }
+      switch (tolower(argv[i][1])) {
+        case '?' :
+        case 'h' :
+          if (argv[i][2])
+            paramerror++;
+          else
+            show_help();
+          return 0;
+        case 'j' :
+          if (argv[i][2])
+            paramerror++;
+          else
+            json = 1;
+          break;
+        case 's' :
+          if ((param = get_param(argc, argv, &i)) == NULL || (corpussize = (size_t)strtoul(param, NULL, 10)) == 0)
+            paramerror++;
+          break;
+        case 'r' :
+          if ((param = get_param(argc, argv, &i)) == NULL || (runs = (size_t)strtoul(param, NULL, 10)) == 0)
+            paramerror++;
+          break;
+        case 'd' :
+          if ((cachedir = get_param(argc, argv, &i)) == NULL)
+            paramerror++;
+          break;
+        case 'm' :
+          if ((param = get_param(argc, argv, &i)) == NULL || parse_numbers(&densities, param) != 0)
+            paramerror++;
+          break;
+        case 'p' :
+          if ((param = get_param(argc, argv, &i)) == NULL || parse_numbers(&patterncounts, param) != 0)
+            paramerror++;
+          break;
+        case 'c' :
+          if ((param = get_param(argc, argv, &i)) == NULL || parse_numbers(&chunksizes, param) != 0)
+            paramerror++;
+          break;
+        case 'l' :
+          if ((param = get_param(argc, argv, &i)) == NULL || parse_numbers(&layercounts, param) != 0)
+            paramerror++;
+          break;
+        case 'o' :
+          if ((param = get_param(argc, argv, &i)) == NULL || parse_names(&sinks, param, sinknames) != 0)
+            paramerror++;
+          break;
+        case 'x' :
+          if ((param = get_param(argc, argv, &i)) == NULL || parse_names(&modes, param, modenames) != 0)
+            paramerror++;
+          break;
+        default :
+          paramerror++;
+          break;
+      }
+    }
+    if (paramerror) {
+      fprintf(stderr, "Invalid command line parameters\n");
+      show_help();
+      return 1;
+    }
+    for (i = 0; i < (int)patterncounts.count; i++) {
+      if (patterncounts.values[i] == 0 || patterncounts.values[i] > 100000) {
+        fprintf(stderr, "Number of patterns must be between 1 and 100000\n");
+        return 1;
+      }
+    }
+    for (i = 0; i < (int)chunksizes.count; i++) {
+      if (chunksizes.values[i] == 0) {
+        fprintf(stderr, "Chunk size can't be 0\n");
+        return 1;
+      }
+    }
+  }
+  //open file for file output
+  for (isink = 0; isink < sinks.count; isink++) {
+    if (sinks.values[isink] == SINK_FILE && !filesink && (filesink = tmpfile()) == NULL) {
+      fprintf(stderr, "Error creating temporary file\n");
+      return 3;
+    }
+  }
+  corpuslen = corpussize * 1024 * 1024;
+  if (!json)
+    printf("mode,sink,layers,patterns,density,chunk_size,bytes,compile_ms,seconds,mb_per_s,matches,matches_per_s,rss_increase_kb\n");
+  //run all combinations
+  for (idensity = 0; idensity < densities.count; idensity++) {
+    for (ipatterns = 0; ipatterns < patterncounts.count; ipatterns++) {
+      if ((corpus = generate_corpus(corpuslen, densities.values[idensity], patterncounts.values[ipatterns])) == NULL) {
+        fprintf(stderr, "Memory allocation error\n");
+        return 2;
+      }
+      for (ilayers = 0; ilayers < layercounts.count; ilayers++) {
+        for (imode = 0; imode < modes.count; imode++) {
+          struct hs_finder* finder;
+          double starttime;
+          double compiletime;
+          unsigned long startrss;
+          int mode = (int)modes.values[imode];
+          //start each combination without output collected by the previous one, so memory used by both is measured
+          free(memorysink.data);
+          memorysink.data = NULL;
+          memorysink.datalen = 0;
+          memorysink.dataalloc = 0;
+          startrss = get_current_rss();
+          //compile patterns (measured separately from searching)
+          if ((finder = create_finder(layercounts.values[ilayers], patterncounts.values[ipatterns], cachedir)) == NULL) {
+            fprintf(stderr, "Error in hs_finder_initialize()\n");
+            return 2;
+          }
+          starttime = get_time();
+          if (mode == MODE_BLOCK) {
+            if (hs_finder_process_block(finder, "", 0, hs_finder_output_to_null, NULL) != HS_SUCCESS) {
+              fprintf(stderr, "Error compiling patterns\n");
+              return 4;
+            }
+          } else {
+            if ((mode == MODE_SCAN ? hs_finder_open_scan_only(finder) : hs_finder_open(finder, hs_finder_output_to_null, NULL)) != HS_SUCCESS) {
+              fprintf(stderr, "Error compiling patterns\n");
+              return 4;
+            }
+            hs_finder_close(finder);
+          }
+          compiletime = get_time() - starttime;
+          //chunk size doesn't apply to block mode and there is no output when only scanning
+          for (ichunk = 0; ichunk < (mode == MODE_BLOCK ? 1 : chunksizes.count); ichunk++) {
+            for (isink = 0; isink < (mode == MODE_SCAN ? 1 : sinks.count); isink++) {
+              double seconds = -1;
+              double t;
+              unsigned long rss;
+              size_t matches = 0;
+              int sink = (mode == MODE_SCAN ? SINK_NULL : (int)sinks.values[isink]);
+              size_t chunksize = (mode == MODE_BLOCK ? corpuslen : chunksizes.values[ichunk]);
+              for (irun = 0; irun < runs; irun++) {
+                if ((t = run_benchmark(finder, corpus, corpuslen, chunksize, mode, sink, &memorysink, filesink)) < 0) {
+                  fprintf(stderr, "Error searching data\n");
+                  return 5;
+                }
+                if (seconds < 0 || t < seconds)
+                  seconds = t;
+              }
+              for (id = 0; id < layercounts.values[ilayers] * patterncounts.values[ipatterns]; id++)
+                matches += hs_finder_get_replacement_count(finder, (unsigned int)id);
+              if (seconds <= 0)
+                seconds = 1e-9;
+              //memory used by this combination (compiled patterns, buffers and collected output)
+              rss = get_current_rss();
+              rss = (rss > startrss ? rss - startrss : 0);
+              if (json)
+                printf("{\"mode\":\"%s\",\"sink\":\"%s\",\"layers\":%lu,\"patterns\":%lu,\"density\":%lu,\"chunk_size\":%lu,\"bytes\":%lu,\"compile_ms\":%.3f,\"seconds\":%.6f,\"mb_per_s\":%.2f,\"matches\":%lu,\"matches_per_s\":%.0f,\"rss_increase_kb\":%lu}\n",
+                  modenames[mode], sinknames[sink], (unsigned long)layercounts.values[ilayers], (unsigned long)patterncounts.values[ipatterns], (unsigned long)densities.values[idensity], (unsigned long)chunksize, (unsigned long)corpuslen,
+                  compiletime * 1000, seconds, corpuslen / (1024.0 * 1024.0) / seconds, (unsigned long)matches, matches / seconds, rss);
+              else
+                printf("%s,%s,%lu,%lu,%lu,%lu,%lu,%.3f,%.6f,%.2f,%lu,%.0f,%lu\n",
+                  modenames[mode], sinknames[sink], (unsigned long)layercounts.values[ilayers], (unsigned long)patterncounts.values[ipatterns], (unsigned long)densities.values[idensity], (unsigned long)chunksize, (unsigned long)corpuslen,
+                  compiletime * 1000, seconds, corpuslen / (1024.0 * 1024.0) / seconds, (unsigned long)matches, matches / seconds, rss);
+              fflush(stdout);
+            }
+          }
+          hs_finder_cleanup(finder);
+        }
+      }
+      free(corpus);
+    }
+  }
+  //clean up
+  if (filesink)
+    fclose(filesink);
+  free(memorysink.data);
+  return 0;
+}
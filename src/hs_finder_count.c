@@ -1,33 +1,555 @@
 #include "hs_finder.h"
+#include "hs_finder_input.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <ctype.h>
 #include <string.h>
+#include <pthread.h>
+#include <dirent.h>
+#include <sys/types.h>
+#include <sys/stat.h>
 
-#define READBUFFERSIZE 128
+//number of patterns listed with -s
+#define PROFILE_TOP 20
+
+//number of input bytes processed between checkpoints saved with -k
+#ifndef CHECKPOINT_INTERVAL
+#define CHECKPOINT_INTERVAL (1024ULL * 1024 * 1024)
+#endif
+
+//statistics of each pattern added up for all streams
+struct profile_data_struct {
+  struct hs_finder_pattern_profile* profile;
+  size_t count;
+  pthread_mutex_t lock;
+};
 
 struct count_data_struct {
   size_t count;
   size_t* patterncounts;
+  unsigned long long skipto;
+  struct profile_data_struct* profiledata;
 };
 
+static void add_pattern (struct hs_finder* finder, const char* pattern, unsigned int flags, int literal, unsigned int id)
+{
+  if (literal)
+    hs_finder_add_literal(finder, pattern, strlen(pattern), flags, id);
+  else
+    hs_finder_add_expr(finder, pattern, flags, id);
+}
+
+static void profile_add (struct profile_data_struct* profiledata, struct hs_finder* finder)
+{
+  size_t i;
+  size_t n;
+  struct hs_finder_pattern_profile* profile;
+  if (!profiledata || (n = hs_finder_get_profile(finder, NULL, 0)) == 0)
+    return;
+  if ((profile = (struct hs_finder_pattern_profile*)malloc(n * sizeof(struct hs_finder_pattern_profile))) == NULL)
+    return;
+  hs_finder_get_profile(finder, profile, n);
+  pthread_mutex_lock(&profiledata->lock);
+  if (!profiledata->profile) {
+    profiledata->profile = profile;
+    profiledata->count = n;
+    profile = NULL;
+  } else {
+    //streams sharing the same patterns return the pattern ids in the same order
+    for (i = 0; i < n && i < profiledata->count; i++) {
+      profiledata->profile[i].matches += profile[i].matches;
+      profiledata->profile[i].callbacktime += profile[i].callbacktime;
+      profiledata->profile[i].retainedbytes += profile[i].retainedbytes;
+    }
+  }
+  pthread_mutex_unlock(&profiledata->lock);
+  free(profile);
+}
+
 static int when_found (unsigned int id, unsigned long long from, unsigned long long to, unsigned int flags, struct hs_finder* finder)
 {
   struct count_data_struct* countdata = (struct count_data_struct*)hs_finder_get_callbackdata(finder);
+  //skip matches in the part that overlaps with the previous thread
+  if (to <= countdata->skipto)
+    return 0;
   countdata->count++;
   countdata->patterncounts[id]++;
   return 0;
 }
 
+struct count_thread_struct {
+  pthread_t thread;
+  struct hs_finder* finder;
+  const char* filename;
+  unsigned long long offset;
+  unsigned long long length;
+  struct count_data_struct countdata;
+  int status;
+};
+
+static void* count_thread (void* param)
+{
+  struct count_thread_struct* threaddata = (struct count_thread_struct*)param;
+  struct hs_finder* stream;
+  struct hs_finder_input* src;
+  const char* buf;
+  size_t buflen;
+  threaddata->status = -1;
+  if ((stream = hs_finder_create_stream(threaddata->finder, &threaddata->countdata)) == NULL)
+    return NULL;
+  if ((src = hs_finder_input_open_range(threaddata->filename, threaddata->offset, threaddata->length)) != NULL) {
+    if (hs_finder_open_scan_only(stream) == HS_SUCCESS) {
+      threaddata->status = 0;
+      while ((buf = hs_finder_input_read(src, &buflen)) != NULL) {
+        if (hs_finder_process(stream, buf, buflen) != HS_SUCCESS)
+          threaddata->status = -1;
+      }
+      if (hs_finder_close(stream) != HS_SUCCESS)
+        threaddata->status = -1;
+      profile_add(threaddata->countdata.profiledata, stream);
+    }
+    hs_finder_input_close(src);
+  }
+  hs_finder_cleanup(stream);
+  return NULL;
+}
+
+//search parts of file in parallel (returns 0 if file can't be split, -1 on error)
+static int count_in_parallel (struct hs_finder* finder, const char* filename, int threads, struct count_data_struct* countdata, size_t patterns)
+{
+  int i;
+  size_t j;
+  size_t overlap;
+  unsigned long long size;
+  unsigned long long partsize;
+  unsigned long long start;
+  unsigned long long end;
+  struct hs_finder_input* src;
+  struct count_thread_struct* threaddata;
+  int result = 1;
+  //data can only be split if matches have a limited length
+  if ((overlap = hs_finder_get_split_overlap(finder)) == HS_FINDER_NO_SPLIT) {
+    fprintf(stderr, "Patterns can match an unlimited number of bytes or at the end of data, using only one thread\n");
+    return 0;
+  }
+  if ((src = hs_finder_input_open(filename)) == NULL)
+    return 0;
+  size = hs_finder_input_get_size(src);
+  hs_finder_input_close(src);
+  if (size == 0)
+    return 0;
+  partsize = (size + threads - 1) / threads;
+  //compile patterns once for all threads
+  if (hs_finder_open_scan_only(finder) != HS_SUCCESS)
+    return -1;
+  hs_finder_close(finder);
+  if ((threaddata = (struct count_thread_struct*)malloc(threads * sizeof(struct count_thread_struct))) == NULL)
+    return -1;
+  for (i = 0; i < threads; i++) {
+    //each part starts before the end of the previous part so matches across the boundary are found
+    start = i * partsize;
+    if ((end = start + partsize) > size)
+      end = size;
+    threaddata[i].finder = finder;
+    threaddata[i].filename = filename;
+    threaddata[i].offset = (start > overlap ? start - overlap : 0);
+    threaddata[i].length = (end > start ? end - threaddata[i].offset : 0);
+    threaddata[i].countdata.count = 0;
+    threaddata[i].countdata.skipto = start - threaddata[i].offset;
+    threaddata[i].countdata.profiledata = countdata->profiledata;
+    threaddata[i].status = -1;
+    if ((threaddata[i].countdata.patterncounts = (size_t*)calloc(patterns + 1, sizeof(size_t))) == NULL || pthread_create(&threaddata[i].thread, NULL, count_thread, &threaddata[i]) != 0) {
+      fprintf(stderr, "Error creating thread\n");
+      free(threaddata[i].countdata.patterncounts);
+      threaddata[i].countdata.patterncounts = NULL;
+      result = -1;
+    }
+  }
+  //wait for threads to finish and add up results
+  for (i = 0; i < threads; i++) {
+    if (threaddata[i].countdata.patterncounts) {
+      pthread_join(threaddata[i].thread, NULL);
+      if (threaddata[i].status != 0)
+        result = -1;
+      countdata->count += threaddata[i].countdata.count;
+      for (j = 0; j < patterns; j++)
+        countdata->patterncounts[j] += threaddata[i].countdata.patterncounts[j];
+      free(threaddata[i].countdata.patterncounts);
+    }
+  }
+  free(threaddata);
+  return result;
+}
+
+struct file_list_struct {
+  char** files;
+  size_t count;
+  size_t alloc;
+};
+
+static int file_list_add (struct file_list_struct* list, const char* path)
+{
+  if (list->count == list->alloc) {
+    char** files;
+    size_t alloc = (list->alloc < 64 ? 64 : list->alloc * 2);
+    if ((files = (char**)realloc(list->files, alloc * sizeof(char*))) == NULL)
+      return -1;
+    list->files = files;
+    list->alloc = alloc;
+  }
+  if ((list->files[list->count] = strdup(path)) == NULL)
+    return -1;
+  list->count++;
+  return 0;
+}
+
+//add all regular files in directory and its subdirectories
+static int file_list_add_dir (struct file_list_struct* list, const char* path)
+{
+  DIR* dir;
+  struct dirent* entry;
+  struct stat st;
+  char* filepath;
+  size_t pathlen = strlen(path);
+  int result = 0;
+  if ((dir = opendir(path)) == NULL) {
+    fprintf(stderr, "Error opening directory: %s\n", path);
+    return -1;
+  }
+  while (result == 0 && (entry = readdir(dir)) != NULL) {
+    if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+      continue;
+    if ((filepath = (char*)malloc(pathlen + strlen(entry->d_name) + 2)) == NULL) {
+      result = -1;
+      break;
+    }
+    sprintf(filepath, "%s%s%s", path, (pathlen > 0 && path[pathlen - 1] != '/' && path[pathlen - 1] != '\\' ? "/" : ""), entry->d_name);
+#ifdef _WIN32
+    if (stat(filepath, &st) == 0) {
+      if (S_ISDIR(st.st_mode))
+        result = file_list_add_dir(list, filepath);
+      else if (S_ISREG(st.st_mode))
+        result = file_list_add(list, filepath);
+    }
+#else
+    if (lstat(filepath, &st) == 0) {
+      if (S_ISDIR(st.st_mode))
+        result = file_list_add_dir(list, filepath);
+      else if (S_ISREG(st.st_mode))
+        result = file_list_add(list, filepath);
+      //follow symbolic links to files, but not to directories
+      else if (S_ISLNK(st.st_mode) && stat(filepath, &st) == 0 && S_ISREG(st.st_mode))
+        result = file_list_add(list, filepath);
+    }
+#endif
+    free(filepath);
+  }
+  closedir(dir);
+  return result;
+}
+
+//read line of any length without line ending (returns NULL at end of file or on error, *line is reused and must be freed by caller)
+static char* read_line (FILE* src, char** line, size_t* linealloc)
+{
+  size_t len = 0;
+  char* newline;
+  if (!*line) {
+    if ((*line = (char*)malloc(256)) == NULL)
+      return NULL;
+    *linealloc = 256;
+  }
+  while (fgets(*line + len, (int)(*linealloc - len), src)) {
+    len += strlen(*line + len);
+    if (len > 0 && (*line)[len - 1] == '\n')
+      break;
+    //line didn't fit, make room for the rest
+    if (len + 1 == *linealloc) {
+      if ((newline = (char*)realloc(*line, *linealloc * 2)) == NULL)
+        return NULL;
+      *line = newline;
+      *linealloc *= 2;
+    }
+  }
+  if (len == 0)
+    return NULL;
+  while (len > 0 && ((*line)[len - 1] == '\n' || (*line)[len - 1] == '\r'))
+    (*line)[--len] = 0;
+  return *line;
+}
+
+//add files listed in file (one per line, "-" for standard input)
+static int file_list_add_from_file (struct file_list_struct* list, const char* listfile)
+{
+  FILE* src;
+  char* line = NULL;
+  size_t linealloc = 0;
+  int result = 0;
+  if (strcmp(listfile, "-") == 0) {
+    src = stdin;
+  } else if ((src = fopen(listfile, "rb")) == NULL) {
+    fprintf(stderr, "Error opening file: %s\n", listfile);
+    return -1;
+  }
+  while (result == 0 && read_line(src, &line, &linealloc)) {
+    if (*line)
+      result = file_list_add(list, line);
+  }
+  free(line);
+  if (src != stdin)
+    fclose(src);
+  return result;
+}
+
+static void file_list_free (struct file_list_struct* list)
+{
+  size_t i;
+  for (i = 0; i < list->count; i++)
+    free(list->files[i]);
+  free(list->files);
+}
+
+struct file_result_struct {
+  size_t count;
+  int status;
+  int done;
+};
+
+//range of files still to be searched by a worker, other workers steal from the end when they run out of work
+struct file_queue_struct {
+  size_t head;
+  size_t tail;
+  pthread_mutex_t lock;
+};
+
+struct file_pool_struct {
+  struct hs_finder* finder;
+  struct file_list_struct* list;
+  struct file_result_struct* results;
+  struct file_queue_struct* queues;
+  int workers;
+  int unordered;
+  int decompress;
+  size_t nextoutput;
+  pthread_mutex_t outputlock;
+};
+
+struct file_worker_struct {
+  pthread_t thread;
+  struct file_pool_struct* pool;
+  int index;
+  struct count_data_struct countdata;
+};
+
+//get index of next file to search (returns 0 if there are no more files)
+static int file_pool_get (struct file_pool_struct* pool, int worker, size_t* file)
+{
+  int i;
+  size_t n;
+  struct file_queue_struct* own = &pool->queues[worker];
+  struct file_queue_struct* victim;
+  pthread_mutex_lock(&own->lock);
+  if (own->head < own->tail) {
+    *file = own->head++;
+    pthread_mutex_unlock(&own->lock);
+    return 1;
+  }
+  pthread_mutex_unlock(&own->lock);
+  //steal half of the remaining files of another worker
+  for (i = 1; i < pool->workers; i++) {
+    victim = &pool->queues[(worker + i) % pool->workers];
+    pthread_mutex_lock(&victim->lock);
+    if ((n = (victim->tail - victim->head + 1) / 2) > 0) {
+      victim->tail -= n;
+      *file = victim->tail;
+      pthread_mutex_unlock(&victim->lock);
+      //only lock own range after releasing the other one to avoid deadlocks
+      pthread_mutex_lock(&own->lock);
+      own->head = *file + 1;
+      own->tail = *file + n;
+      pthread_mutex_unlock(&own->lock);
+      return 1;
+    }
+    pthread_mutex_unlock(&victim->lock);
+  }
+  return 0;
+}
+
+static void file_pool_show_result (struct file_pool_struct* pool, size_t file)
+{
+  if (pool->results[file].status != 0)
+    fprintf(stderr, "Error searching file: %s\n", pool->list->files[file]);
+  else
+    printf("%s: %lu matches found\n", pool->list->files[file], (unsigned long)pool->results[file].count);
+}
+
+//show result of file (in order of the file list unless unordered output was requested)
+static void file_pool_report (struct file_pool_struct* pool, size_t file)
+{
+  pthread_mutex_lock(&pool->outputlock);
+  pool->results[file].done = 1;
+  if (pool->unordered) {
+    file_pool_show_result(pool, file);
+  } else {
+    while (pool->nextoutput < pool->list->count && pool->results[pool->nextoutput].done)
+      file_pool_show_result(pool, pool->nextoutput++);
+  }
+  pthread_mutex_unlock(&pool->outputlock);
+}
+
+static int count_file (struct hs_finder* stream, const char* filename, int decompress)
+{
+  struct hs_finder_input* src;
+  const char* buf;
+  size_t buflen;
+  int result = 0;
+  if ((src = (decompress ? hs_finder_input_open_decompress(filename) : hs_finder_input_open(filename))) == NULL)
+    return -1;
+  if (hs_finder_open_scan_only(stream) != HS_SUCCESS) {
+    hs_finder_input_close(src);
+    return -1;
+  }
+  while ((buf = hs_finder_input_read(src, &buflen)) != NULL) {
+    if (hs_finder_process(stream, buf, buflen) != HS_SUCCESS)
+      result = -1;
+  }
+  if (hs_finder_close(stream) != HS_SUCCESS)
+    result = -1;
+  hs_finder_input_close(src);
+  return result;
+}
+
+static void* file_worker_thread (void* param)
+{
+  size_t file;
+  size_t count;
+  struct hs_finder* stream;
+  struct file_worker_struct* worker = (struct file_worker_struct*)param;
+  struct file_pool_struct* pool = worker->pool;
+  //each worker searches with its own stream (and scratch space) sharing the compiled patterns
+  stream = hs_finder_create_stream(pool->finder, &worker->countdata);
+  while (file_pool_get(pool, worker->index, &file)) {
+    count = worker->countdata.count;
+    pool->results[file].status = (stream ? count_file(stream, pool->list->files[file], pool->decompress) : -1);
+    pool->results[file].count = worker->countdata.count - count;
+    if (stream)
+      profile_add(worker->countdata.profiledata, stream);
+    file_pool_report(pool, file);
+  }
+  hs_finder_cleanup(stream);
+  return NULL;
+}
+
+//search files with a pool of worker threads (returns number of files that couldn't be searched, or -1 on error)
+static long count_files (struct hs_finder* finder, struct file_list_struct* list, int threads, int unordered, int decompress, struct count_data_struct* countdata, size_t patterns)
+{
+  int i;
+  size_t j;
+  struct file_pool_struct pool;
+  struct file_worker_struct* workers;
+  long result = 0;
+  //compile patterns once for all threads
+  if (hs_finder_open_scan_only(finder) != HS_SUCCESS)
+    return -1;
+  hs_finder_close(finder);
+  pool.finder = finder;
+  pool.list = list;
+  pool.workers = threads;
+  pool.unordered = unordered;
+  pool.decompress = decompress;
+  pool.nextoutput = 0;
+  pool.results = (struct file_result_struct*)calloc(list->count + 1, sizeof(struct file_result_struct));
+  pool.queues = (struct file_queue_struct*)malloc(threads * sizeof(struct file_queue_struct));
+  workers = (struct file_worker_struct*)malloc(threads * sizeof(struct file_worker_struct));
+  if (!pool.results || !pool.queues || !workers) {
+    free(pool.results);
+    free(pool.queues);
+    free(workers);
+    return -1;
+  }
+  pthread_mutex_init(&pool.outputlock, NULL);
+  //divide files evenly over workers
+  for (i = 0; i < threads; i++) {
+    pool.queues[i].head = list->count * i / threads;
+    pool.queues[i].tail = list->count * (i + 1) / threads;
+    pthread_mutex_init(&pool.queues[i].lock, NULL);
+  }
+  for (i = 0; i < threads; i++) {
+    workers[i].pool = &pool;
+    workers[i].index = i;
+    workers[i].countdata.count = 0;
+    workers[i].countdata.skipto = 0;
+    workers[i].countdata.profiledata = countdata->profiledata;
+    if ((workers[i].countdata.patterncounts = (size_t*)calloc(patterns + 1, sizeof(size_t))) == NULL || pthread_create(&workers[i].thread, NULL, file_worker_thread, &workers[i]) != 0) {
+      fprintf(stderr, "Error creating thread\n");
+      free(workers[i].countdata.patterncounts);
+      workers[i].countdata.patterncounts = NULL;
+      result = -1;
+    }
+  }
+  //wait for workers to finish and add up results
+  for (i = 0; i < threads; i++) {
+    if (workers[i].countdata.patterncounts) {
+      pthread_join(workers[i].thread, NULL);
+      countdata->count += workers[i].countdata.count;
+      for (j = 0; j < patterns; j++)
+        countdata->patterncounts[j] += workers[i].countdata.patterncounts[j];
+      free(workers[i].countdata.patterncounts);
+    }
+    pthread_mutex_destroy(&pool.queues[i].lock);
+  }
+  if (result == 0) {
+    for (j = 0; j < list->count; j++)
+      if (pool.results[j].status != 0)
+        result++;
+  }
+  pthread_mutex_destroy(&pool.outputlock);
+  free(pool.results);
+  free(pool.queues);
+  free(workers);
+  return result;
+}
+
+//continue from checkpoint (returns 0 if file doesn't exist, 1 on success, -1 on error)
+static int load_checkpoint (struct hs_finder* finder, const char* filename, struct hs_finder_input* src, struct count_data_struct* countdata, size_t patterns, unsigned long long* inputpos)
+{
+  size_t i;
+  FILE* checkpoint;
+  if ((checkpoint = fopen(filename, "rb")) == NULL)
+    return 0;
+  fclose(checkpoint);
+  //counts of each pattern are saved with the checkpoint
+  if (hs_finder_load_checkpoint(finder, filename, inputpos, countdata->patterncounts, patterns * sizeof(size_t)) != HS_SUCCESS)
+    return -1;
+  countdata->count = 0;
+  for (i = 0; i < patterns; i++)
+    countdata->count += countdata->patterncounts[i];
+  if (hs_finder_input_skip(src, *inputpos) != *inputpos) {
+    fprintf(stderr, "Input is shorter than at checkpoint\n");
+    return -1;
+  }
+  fprintf(stderr, "Continuing from checkpoint after %llu bytes of input\n", *inputpos);
+  return 1;
+}
+
 void show_help()
 {
   printf(
-    "Usage:  hs_finder_count [[-?|-h] -c] [-i] [-f file] [-t text] [-p <pattern>] <pattern> ...\n" \
+    "Usage:  hs_finder_count [[-?|-h] -c] [-i] [-e] [-g] [-d dir] [-f file] [-r dir] [-l file] [-u] [-j threads] [-k file] [-z] [-s] [-t text] [-p <pattern>] <pattern> ...\n" \
     "Parameters:\n" \
     "  -? | -h     \tshow help\n" \
     "  -c          \tcase sensitive matching for next pattern(s) (default)\n" \
     "  -i          \tcase insensitive matching for next pattern(s)\n" \
+    "  -e          \tnext pattern(s) are literal strings\n" \
+    "  -g          \tnext pattern(s) are regular expressions (default)\n" \
+    "  -d dir      \tdirectory for caching compiled patterns\n" \
     "  -f file     \tinput file (default is to use standard input)\n" \
+    "  -r dir      \tsearch all files in directory and its subdirectories\n" \
+    "  -l file     \tsearch all files listed in file (one per line, use \"-\" for standard input)\n" \
+    "  -u          \tshow results for multiple files in the order they are finished\n" \
+    "  -j threads  \tnumber of threads searching parts of input file or multiple files (default is 1)\n" \
+    "  -k file     \tsave checkpoints to file and continue from it if it exists (only for one input file, not with -t or -j)\n" \
+    "  -z          \tdecompress gzip or zstd compressed input (parts of a file are not searched in parallel)\n" \
+    "  -s          \tprint statistics of the most expensive patterns to standard error\n" \
     "  -t text     \tuse text as search data (overrides -f)\n" \
     "  -n          \tcreate new search instance\n" \
     "  -p pattern  \tpattern to search for (can be used if pattern starts with \"-\")\n" \
@@ -37,13 +559,31 @@ void show_help()
   );
 }
 
+//free everything allocated in main()
+static void free_resources (struct hs_finder* finder, struct file_list_struct* filelist, size_t* patterncounts, struct profile_data_struct* profiledata)
+{
+  free(profiledata->profile);
+  pthread_mutex_destroy(&profiledata->lock);
+  file_list_free(filelist);
+  free(patterncounts);
+  hs_finder_cleanup(finder);
+}
+
 int main (int argc, char** argv)
 {
   struct hs_finder* finder;
   struct count_data_struct countdata;
+  struct profile_data_struct profiledata;
   int flags = HS_FLAG_SOM_LEFTMOST | HS_FLAG_DOTALL;
+  int literal = 0;
   const char* srcfile = NULL;
   const char* srctext = NULL;
+  int threads = 1;
+  int unordered = 0;
+  int decompress = 0;
+  const char* checkpointfile = NULL;
+  int status;
+  struct file_list_struct filelist = {NULL, 0, 0};
   size_t* patterncounts = NULL;
   size_t patterns = 0;
   //initialize
@@ -53,10 +593,17 @@ int main (int argc, char** argv)
   }
   countdata.count = 0;
   countdata.patterncounts = patterncounts;
+  countdata.skipto = 0;
+  countdata.profiledata = NULL;
+  memset(&profiledata, 0, sizeof(profiledata));
+  pthread_mutex_init(&profiledata.lock, NULL);
   if ((finder = hs_finder_initialize(when_found, &countdata)) == NULL) {
     fprintf(stderr, "Error in hs_finder_initialize()\n");
+    free_resources(NULL, &filelist, patterncounts, &profiledata);
     return 3;
   }
+  //the start of matches is not used for counting
+  hs_finder_set_som_horizon(finder, HS_FINDER_SOM_NONE);
   //process command line parameters
   {
     int i = 0;
@@ -72,6 +619,7 @@ int main (int argc, char** argv)
               paramerror++;
             else
               show_help();
+            free_resources(finder, &filelist, patterncounts, &profiledata);
             return 0;
           case 'c' :
             if (argv[i][2])
@@ -85,6 +633,28 @@ int main (int argc, char** argv)
             else
               flags |= HS_FLAG_CASELESS;
             break;
+          case 'e' :
+            if (argv[i][2])
+              paramerror++;
+            else
+              literal = 1;
+            break;
+          case 'g' :
+            if (argv[i][2])
+              paramerror++;
+            else
+              literal = 0;
+            break;
+          case 'd' :
+            if (argv[i][2])
+              param = argv[i] + 2;
+            else if (i + 1 < argc && argv[i + 1])
+              param = argv[++i];
+            if (!param)
+              paramerror++;
+            else
+              hs_finder_set_cache_dir(finder, param);
+            break;
           case 'f' :
             if (argv[i][2])
               param = argv[i] + 2;
@@ -95,6 +665,60 @@ int main (int argc, char** argv)
             else
               srcfile = param;
             break;
+          case 'r' :
+            if (argv[i][2])
+              param = argv[i] + 2;
+            else if (i + 1 < argc && argv[i + 1])
+              param = argv[++i];
+            if (!param || file_list_add_dir(&filelist, param) != 0)
+              paramerror++;
+            break;
+          case 'l' :
+            if (argv[i][2])
+              param = argv[i] + 2;
+            else if (i + 1 < argc && argv[i + 1])
+              param = argv[++i];
+            if (!param || file_list_add_from_file(&filelist, param) != 0)
+              paramerror++;
+            break;
+          case 'u' :
+            if (argv[i][2])
+              paramerror++;
+            else
+              unordered = 1;
+            break;
+          case 'j' :
+            if (argv[i][2])
+              param = argv[i] + 2;
+            else if (i + 1 < argc && argv[i + 1])
+              param = argv[++i];
+            if (!param || (threads = atoi(param)) < 1)
+              paramerror++;
+            break;
+          case 'k' :
+            if (argv[i][2])
+              param = argv[i] + 2;
+            else if (i + 1 < argc && argv[i + 1])
+              param = argv[++i];
+            if (!param)
+              paramerror++;
+            else
+              checkpointfile = param;
+            break;
+          case 'z' :
+            if (argv[i][2])
+              paramerror++;
+            else
+              decompress = 1;
+            break;
+          case 's' :
+            if (argv[i][2])
+              paramerror++;
+            else {
+              countdata.profiledata = &profiledata;
+              hs_finder_set_profiling(finder, 1);
+            }
+            break;
           case 't' :
             if (argv[i][2])
               param = argv[i] + 2;
@@ -120,7 +744,7 @@ int main (int argc, char** argv)
               paramerror++;
             else {
               patterncounts[patterns] = 0;
-              hs_finder_add_expr(finder, param, HS_FLAG_SOM_LEFTMOST | HS_FLAG_DOTALL | flags, patterns++);
+              add_pattern(finder, param, HS_FLAG_SOM_LEFTMOST | HS_FLAG_DOTALL | flags, literal, patterns++);
             }
             break;
           default :
@@ -129,50 +753,97 @@ int main (int argc, char** argv)
         }
       } else {
         patterncounts[patterns] = 0;
-        hs_finder_add_expr(finder, param, HS_FLAG_SOM_LEFTMOST | HS_FLAG_DOTALL | flags, patterns++);
+        add_pattern(finder, argv[i], HS_FLAG_SOM_LEFTMOST | HS_FLAG_DOTALL | flags, literal, patterns++);
       }
     }
+    //checkpoints are only saved when searching one input from start to end
+    if (checkpointfile && (srctext || filelist.count > 0 || threads > 1))
+      paramerror++;
     if (paramerror || argc <= 1) {
       if (paramerror)
         fprintf(stderr, "Invalid command line parameters\n");
       show_help();
+      free_resources(finder, &filelist, patterncounts, &profiledata);
       return 1;
     }
   }
-  //prepare finder for searching
-  if (hs_finder_open(finder, hs_finder_output_to_null, NULL) != HS_SUCCESS) {
-    fprintf(stderr, "Error in hs_finder_open()\n");
-    hs_finder_cleanup(finder);
-    return 4;
-  }
   //process search data
   if (srctext) {
-    //process supplied text
-    if (hs_finder_process(finder, srctext, strlen(srctext)) != HS_SUCCESS) {
-      fprintf(stderr, "Error in hs_finder_open()\n");
+    //process supplied text all at once
+    if (hs_finder_process_block_scan_only(finder, srctext, strlen(srctext)) != HS_SUCCESS) {
+      fprintf(stderr, "Error in hs_finder_process_block_scan_only()\n");
+    }
+    profile_add(countdata.profiledata, finder);
+  } else if (filelist.count > 0) {
+    //process multiple files
+    long errors;
+    if (srcfile && file_list_add(&filelist, srcfile) != 0) {
+      fprintf(stderr, "Memory allocation error\n");
+      free_resources(finder, &filelist, patterncounts, &profiledata);
+      return 2;
+    }
+    if ((errors = count_files(finder, &filelist, threads, unordered, decompress, &countdata, patterns)) < 0) {
+      fprintf(stderr, "Error searching files\n");
+      free_resources(finder, &filelist, patterncounts, &profiledata);
+      return 5;
+    }
+    printf("%lu files searched", (unsigned long)filelist.count);
+    if (errors > 0)
+      printf(", %li files could not be searched", errors);
+    printf("\n");
+  } else if (threads > 1 && srcfile && !decompress && (status = count_in_parallel(finder, srcfile, threads, &countdata, patterns)) != 0) {
+    //process parts of file in parallel
+    if (status < 0) {
+      fprintf(stderr, "Error searching file: %s\n", srcfile);
+      free_resources(finder, &filelist, patterncounts, &profiledata);
+      return 5;
     }
   } else {
     //process file (or standard input)
-    FILE* src;
-    char buf[READBUFFERSIZE];
+    struct hs_finder_input* src;
+    const char* buf;
     size_t buflen;
-    if (!srcfile) {
-      src = stdin;
-    } else {
-      if ((src = fopen(srcfile, "rb")) == NULL) {
-        fprintf(stderr, "Error opening file: %s\n", srcfile);
-        hs_finder_cleanup(finder);
-        return 5;
+    unsigned long long inputpos = 0;
+    int failed = 0;
+    //prepare finder for searching
+    if (hs_finder_open_scan_only(finder) != HS_SUCCESS) {
+      fprintf(stderr, "Error in hs_finder_open()\n");
+      free_resources(finder, &filelist, patterncounts, &profiledata);
+      return 4;
+    }
+    if ((src = (decompress ? hs_finder_input_open_decompress(srcfile) : hs_finder_input_open(srcfile))) == NULL) {
+      fprintf(stderr, "Error opening file: %s\n", (srcfile ? srcfile : "standard input"));
+      free_resources(finder, &filelist, patterncounts, &profiledata);
+      return 5;
+    }
+    //continue from checkpoint if it exists
+    if (checkpointfile && (status = load_checkpoint(finder, checkpointfile, src, &countdata, patterns, &inputpos)) != 0) {
+      if (status < 0) {
+        fprintf(stderr, "Error continuing from checkpoint file: %s\n", checkpointfile);
+        hs_finder_input_close(src);
+        free_resources(finder, &filelist, patterncounts, &profiledata);
+        return 6;
       }
     }
-    while ((buflen = fread(buf, 1, READBUFFERSIZE, src)) > 0) {
+    while ((buf = hs_finder_input_read(src, &buflen)) != NULL) {
       if (hs_finder_process(finder, buf, buflen) != HS_SUCCESS) {
-        fprintf(stderr, "Error in hs_finder_open()\n");
+        fprintf(stderr, "Error in hs_finder_process()\n");
+        failed = 1;
+      }
+      //save checkpoint each time another CHECKPOINT_INTERVAL bytes were processed
+      inputpos += buflen;
+      if (checkpointfile && inputpos / CHECKPOINT_INTERVAL != (inputpos - buflen) / CHECKPOINT_INTERVAL) {
+        if (hs_finder_save_checkpoint(finder, checkpointfile, inputpos, patterncounts, patterns * sizeof(size_t)) != HS_SUCCESS)
+          fprintf(stderr, "Error saving checkpoint file: %s\n", checkpointfile);
       }
     }
-    fclose(src);
+    hs_finder_input_close(src);
+    hs_finder_close(finder);
+    //checkpoint is no longer needed when all data was processed
+    if (checkpointfile && !failed)
+      remove(checkpointfile);
+    profile_add(countdata.profiledata, finder);
   }
-  hs_finder_close(finder);
   //show results
   printf("%lu matches found\n", (unsigned long)countdata.count);
   {
@@ -180,8 +851,9 @@ int main (int argc, char** argv)
     for (i = 0; i < patterns; i++)
       printf("pattern %lu found %lu times\n", (unsigned long)i + 1, (unsigned long)patterncounts[i]);
   }
+  if (countdata.profiledata)
+    hs_finder_write_profile(profiledata.profile, profiledata.count, PROFILE_TOP, stderr);
   //clean up
-  free(patterncounts);
-  hs_finder_cleanup(finder);
+  free_resources(finder, &filelist, patterncounts, &profiledata);
   return 0;
 }
@@ -1,30 +1,74 @@
 #include "hs_finder.h"
+#include "hs_finder_input.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <ctype.h>
 #include <string.h>
+#ifdef _WIN32
+#include <io.h>
+#define fsync _commit
+#define ftruncate _chsize_s
+#define lseek _lseeki64
+#else
+#include <unistd.h>
+#endif
 
-#define READBUFFERSIZE 128
+//number of patterns listed with -s
+#define PROFILE_TOP 20
 
-struct replace_data_struct {
-  size_t count;
-  size_t* patterncounts;
-  const char** patternreplacements;
-};
+//number of input bytes processed between checkpoints saved with -k
+#ifndef CHECKPOINT_INTERVAL
+#define CHECKPOINT_INTERVAL (1024ULL * 1024 * 1024)
+#endif
 
-static int when_found (unsigned int id, unsigned long long from, unsigned long long to, unsigned int flags, struct hs_finder* finder)
+static void add_pattern (struct hs_finder* finder, const char* pattern, const char* replacement, unsigned int flags, int literal, unsigned int id)
 {
-  struct replace_data_struct* replacedata = (struct replace_data_struct*)hs_finder_get_callbackdata(finder);
-  replacedata->count++;
-  replacedata->patterncounts[id]++;
-  if (hs_finder_get_pos(finder) <= from) {
-    hs_finder_flush(finder, from);
-    hs_finder_skip(finder, to);
-    hs_finder_output(finder, replacedata->patternreplacements[id], strlen(replacedata->patternreplacements[id]));
-  } else {
-    //multiple match found
-    fprintf(stderr, "Overlapping match %lu from position %lu to position %lu\n", (unsigned long)id, (unsigned long)from, (unsigned long)to);
+  if (literal)
+    hs_finder_add_literal(finder, pattern, strlen(pattern), HS_FLAG_SOM_LEFTMOST | flags, id);
+  else
+    hs_finder_add_expr(finder, pattern, HS_FLAG_SOM_LEFTMOST | HS_FLAG_DOTALL | flags, id);
+  hs_finder_set_replacement(finder, id, replacement, strlen(replacement));
+}
+
+//show the most expensive patterns
+static void show_profile (struct hs_finder* finder)
+{
+  size_t n;
+  struct hs_finder_pattern_profile* profile;
+  n = hs_finder_get_profile(finder, NULL, 0);
+  if ((profile = (struct hs_finder_pattern_profile*)malloc((n > 0 ? n : 1) * sizeof(struct hs_finder_pattern_profile))) != NULL) {
+    hs_finder_get_profile(finder, profile, n);
+    hs_finder_write_profile(profile, n, PROFILE_TOP, stderr);
+    free(profile);
+  }
+}
+
+//save checkpoint after output up to this point is on disk (returns non-zero on error)
+static int save_checkpoint (struct hs_finder* finder, const char* filename, unsigned long long inputpos, int dstfd)
+{
+  unsigned long long outputpos;
+  hs_finder_flush_output(finder);
+  if (fsync(dstfd) != 0)
+    return -1;
+  outputpos = (unsigned long long)lseek(dstfd, 0, SEEK_CUR);
+  return (hs_finder_save_checkpoint(finder, filename, inputpos, &outputpos, sizeof(outputpos)) == HS_SUCCESS ? 0 : -1);
+}
+
+//continue from checkpoint, discarding output written after it was saved (returns non-zero on error)
+static int load_checkpoint (struct hs_finder* finder, const char* filename, struct hs_finder_input* src, int dstfd, unsigned long long* inputpos)
+{
+  unsigned long long outputpos;
+  if (hs_finder_load_checkpoint(finder, filename, inputpos, &outputpos, sizeof(outputpos)) != HS_SUCCESS)
+    return -1;
+  if (ftruncate(dstfd, outputpos) != 0 || lseek(dstfd, 0, SEEK_END) < 0) {
+    fprintf(stderr, "Error truncating output file to checkpoint\n");
+    return -1;
   }
+  if (hs_finder_input_skip(src, *inputpos) != *inputpos) {
+    fprintf(stderr, "Input is shorter than at checkpoint\n");
+    return -1;
+  }
+  fprintf(stderr, "Continuing from checkpoint after %llu bytes of input\n", *inputpos);
   return 0;
 }
 
@@ -37,16 +81,24 @@ void flushsearchdata (const char* data, size_t datalen, void* callbackdata)
 void show_help()
 {
   printf(
-    "Usage:  hs_finder_replace [-?|-h] [-c] [-i] [-f file] [-t text] [-p <pattern> <replacement>] <pattern> <replacement> ...\n" \
+    "Usage:  hs_finder_replace [-?|-h] [-c] [-i] [-e] [-g] [-d dir] [-f file] [-o file] [-k file] [-z] [-v] [-s] [-t text] [-n] [-m] [-x policy] [-p <pattern> <replacement>] <pattern> <replacement> ...\n" \
     "Parameters:\n" \
     "  -? | -h     \tshow help\n" \
     "  -c          \tcase sensitive matching for next pattern(s) (default)\n" \
     "  -i          \tcase insensitive matching for next pattern(s)\n" \
+    "  -e          \tnext pattern(s) are literal strings\n" \
+    "  -g          \tnext pattern(s) are regular expressions (default)\n" \
+    "  -d dir      \tdirectory for caching compiled patterns\n" \
     "  -f file     \tinput file (default is to use standard input)\n" \
     "  -o file     \toutput file (default is to use standard output)\n" \
+    "  -k file     \tsave checkpoints to file and continue from it if it exists (requires -o, not with -t or -m)\n" \
+    "  -z          \tdecompress gzip or zstd compressed input\n" \
     "  -v          \tprint number of replacements done\n" \
+    "  -s          \tprint statistics of the most expensive patterns to standard error\n" \
     "  -t text     \tuse text as search data (overrides -f)\n" \
     "  -n          \tcreate new search instance\n" \
+    "  -m          \trun each search instance in a separate thread\n" \
+    "  -x policy   \tmatch to replace when matches overlap (longest = leftmost longest match (default), first = leftmost shortest match, priority = first specified pattern)\n" \
     "  -p          \tnext 2 parameters are pattern and replacement (can be used if pattern or replacement starts with \"-\")\n" \
     "  pattern     \tpattern to search for\n" \
     "  replacement \treplacement to replace pattern with\n" \
@@ -58,29 +110,21 @@ void show_help()
 int main (int argc, char** argv)
 {
   struct hs_finder* finder;
-  struct replace_data_struct replacedata;
   FILE* dst;
   int flags = 0;
+  int literal = 0;
   int verbose = 0;
+  int profiling = 0;
+  int decompress = 0;
   const char* srcfile = NULL;
   const char* dstfile = NULL;
   const char* srctext = NULL;
-  size_t* patterncounts = NULL;
-  const char** patternreplacements = NULL;
-  size_t patterns = 0;
+  const char* checkpointfile = NULL;
+  int resume = 0;
+  int pipeline = 0;
+  unsigned int patterns = 0;
   //initialize
-  if ((patterncounts = (size_t*)malloc((argc - 1) * sizeof(size_t))) == NULL) {
-    fprintf(stderr, "Memory allocation error\n");
-    return 2;
-  }
-  if ((patternreplacements = (const char**)malloc((argc - 1) * sizeof(char*))) == NULL) {
-    fprintf(stderr, "Memory allocation error\n");
-    return 2;
-  }
-  replacedata.count = 0;
-  replacedata.patterncounts = patterncounts;
-  replacedata.patternreplacements = patternreplacements;
-  if ((finder = hs_finder_initialize(when_found, &replacedata)) == NULL) {
+  if ((finder = hs_finder_initialize(NULL, NULL)) == NULL) {
     fprintf(stderr, "Error in hs_finder_initialize()\n");
     return 2;
   }
@@ -112,6 +156,28 @@ int main (int argc, char** argv)
             else
               flags |= HS_FLAG_CASELESS;
             break;
+          case 'e' :
+            if (argv[i][2])
+              paramerror++;
+            else
+              literal = 1;
+            break;
+          case 'g' :
+            if (argv[i][2])
+              paramerror++;
+            else
+              literal = 0;
+            break;
+          case 'd' :
+            if (argv[i][2])
+              param = argv[i] + 2;
+            else if (i + 1 < argc && argv[i + 1])
+              param = argv[++i];
+            if (!param)
+              paramerror++;
+            else
+              hs_finder_set_cache_dir(finder, param);
+            break;
           case 'f' :
             if (argv[i][2])
               param = argv[i] + 2;
@@ -132,12 +198,36 @@ int main (int argc, char** argv)
             else
               dstfile = param;
             break;
+          case 'k' :
+            if (argv[i][2])
+              param = argv[i] + 2;
+            else if (i + 1 < argc && argv[i + 1])
+              param = argv[++i];
+            if (!param)
+              paramerror++;
+            else
+              checkpointfile = param;
+            break;
+          case 'z' :
+            if (argv[i][2])
+              paramerror++;
+            else
+              decompress = 1;
+            break;
           case 'v' :
             if (argv[i][2])
               paramerror++;
             else
               verbose = 1;
             break;
+          case 's' :
+            if (argv[i][2])
+              paramerror++;
+            else {
+              profiling = 1;
+              hs_finder_set_profiling(finder, 1);
+            }
+            break;
           case 't' :
             if (argv[i][2])
               param = argv[i] + 2;
@@ -152,7 +242,31 @@ int main (int argc, char** argv)
             if (argv[i][2])
               paramerror++;
             else
-              hs_finder_add_instance(finder, when_found, &replacedata);
+              hs_finder_add_instance(finder, NULL, NULL);
+            break;
+          case 'm' :
+            if (argv[i][2])
+              paramerror++;
+            else {
+              pipeline = 1;
+              hs_finder_set_pipeline(finder, 1);
+            }
+            break;
+          case 'x' :
+            if (argv[i][2])
+              param = argv[i] + 2;
+            else if (i + 1 < argc && argv[i + 1])
+              param = argv[++i];
+            if (!param)
+              paramerror++;
+            else if (strcmp(param, "longest") == 0)
+              hs_finder_set_overlap_policy(finder, HS_FINDER_OVERLAP_LEFTMOST_LONGEST);
+            else if (strcmp(param, "first") == 0)
+              hs_finder_set_overlap_policy(finder, HS_FINDER_OVERLAP_FIRST_START);
+            else if (strcmp(param, "priority") == 0)
+              hs_finder_set_overlap_policy(finder, HS_FINDER_OVERLAP_PRIORITY);
+            else
+              paramerror++;
             break;
           case 'p' :
             {
@@ -165,11 +279,8 @@ int main (int argc, char** argv)
               }
               if (!param || !param2)
                 paramerror++;
-              else {
-                patterncounts[patterns] = 0;
-                patternreplacements[patterns] = param2;
-                hs_finder_add_expr(finder, param, HS_FLAG_SOM_LEFTMOST | HS_FLAG_DOTALL | flags, patterns++);
-              }
+              else
+                add_pattern(finder, param, param2, flags, literal, patterns++);
               break;
             }
           default :
@@ -177,15 +288,16 @@ int main (int argc, char** argv)
             break;
         }
       } else if (i + 1 < argc) {
-        patterncounts[patterns] = 0;
-        patternreplacements[patterns] = argv[i + 1];
-        hs_finder_add_expr(finder, argv[i], HS_FLAG_SOM_LEFTMOST | HS_FLAG_DOTALL | flags, patterns++);
+        add_pattern(finder, argv[i], argv[i + 1], flags, literal, patterns++);
         i++;
       } else {
         paramerror++;
         break;
       }
     }
+    //checkpoints refer to a position in the output file and can't be saved while search instances run in threads
+    if (checkpointfile && (!dstfile || srctext || pipeline))
+      paramerror++;
     if (paramerror || argc <= 1) {
       if (paramerror)
         fprintf(stderr, "Invalid command line parameters\n");
@@ -193,62 +305,88 @@ int main (int argc, char** argv)
       return 1;
     }
   }
+  //continue from checkpoint if it exists
+  if (checkpointfile) {
+    FILE* checkpoint;
+    if ((checkpoint = fopen(checkpointfile, "rb")) != NULL) {
+      fclose(checkpoint);
+      resume = 1;
+    }
+  }
   //open output
   if (!dstfile)
     dst = stdout;
   else
-    dst = fopen(dstfile, "wb");
+    dst = fopen(dstfile, (resume ? "r+b" : "wb"));
   if (dst == NULL) {
     fprintf(stderr, "Error opening output file: %s\n", srcfile);
     hs_finder_cleanup(finder);
     return 3;
   }
-  //prepare finder for searching
-  if (hs_finder_open(finder, hs_finder_output_to_stream, dst) != HS_SUCCESS) {
-    fprintf(stderr, "Error in hs_finder_open()\n");
-    hs_finder_cleanup(finder);
-    return 4;
-  }
   //process search data
   if (srctext) {
-    //process supplied text
-    if (hs_finder_process(finder, srctext, strlen(srctext)) != HS_SUCCESS) {
-      fprintf(stderr, "Error in hs_finder_open()\n");
+    //process supplied text all at once
+    if (hs_finder_process_block(finder, srctext, strlen(srctext), hs_finder_output_to_stream, dst) != HS_SUCCESS) {
+      fprintf(stderr, "Error in hs_finder_process_block()\n");
     }
   } else {
     //process file (or standard input)
-    FILE* src;
-    char buf[READBUFFERSIZE];
+    struct hs_finder_input* src;
+    const char* buf;
     size_t buflen;
-    if (!srcfile) {
-      src = stdin;
-    } else {
-      if ((src = fopen(srcfile, "rb")) == NULL) {
-        fprintf(stderr, "Error opening file: %s\n", srcfile);
-        hs_finder_cleanup(finder);
-        return 5;
-      }
+    unsigned long long inputpos = 0;
+    int failed = 0;
+    int dstfd = fileno(dst);
+    //prepare finder for searching (output is written in large batches directly to the file descriptor)
+    if (hs_finder_open_v(finder, hs_finder_outputv_to_fd, &dstfd) != HS_SUCCESS) {
+      fprintf(stderr, "Error in hs_finder_open_v()\n");
+      hs_finder_cleanup(finder);
+      return 4;
     }
-    while ((buflen = fread(buf, 1, READBUFFERSIZE, src)) > 0) {
+    if ((src = (decompress ? hs_finder_input_open_decompress(srcfile) : hs_finder_input_open(srcfile))) == NULL) {
+      fprintf(stderr, "Error opening file: %s\n", (srcfile ? srcfile : "standard input"));
+      hs_finder_cleanup(finder);
+      return 5;
+    }
+    if (resume && load_checkpoint(finder, checkpointfile, src, dstfd, &inputpos) != 0) {
+      fprintf(stderr, "Error continuing from checkpoint file: %s\n", checkpointfile);
+      hs_finder_input_close(src);
+      hs_finder_cleanup(finder);
+      return 6;
+    }
+    while ((buf = hs_finder_input_read(src, &buflen)) != NULL) {
       if (hs_finder_process(finder, buf, buflen) != HS_SUCCESS) {
-        fprintf(stderr, "Error in hs_finder_open()\n");
+        fprintf(stderr, "Error in hs_finder_process()\n");
+        failed = 1;
+      }
+      //save checkpoint each time another CHECKPOINT_INTERVAL bytes were processed
+      inputpos += buflen;
+      if (checkpointfile && inputpos / CHECKPOINT_INTERVAL != (inputpos - buflen) / CHECKPOINT_INTERVAL) {
+        if (save_checkpoint(finder, checkpointfile, inputpos, dstfd) != 0)
+          fprintf(stderr, "Error saving checkpoint file: %s\n", checkpointfile);
       }
     }
-    fclose(src);
+    hs_finder_input_close(src);
+    hs_finder_close(finder);
+    //checkpoint is no longer needed when all data was processed
+    if (checkpointfile && !failed)
+      remove(checkpointfile);
   }
-  hs_finder_close(finder);
   //show results
   if (verbose) {
-    size_t i;
+    unsigned int i;
+    size_t count = 0;
+    for (i = 0; i < patterns; i++)
+      count += hs_finder_get_replacement_count(finder, i);
     if (dst == stdout)
       printf("\n");
-    printf("%lu matches replaced\n", (unsigned long)replacedata.count);
+    printf("%lu matches replaced\n", (unsigned long)count);
     for (i = 0; i < patterns; i++)
-      printf("pattern %lu replaced %lu times\n", (unsigned long)i + 1, (unsigned long)patterncounts[i]);
+      printf("pattern %lu replaced %lu times\n", (unsigned long)i + 1, (unsigned long)hs_finder_get_replacement_count(finder, i));
   }
+  if (profiling)
+    show_profile(finder);
   //clean up
-  free(patterncounts);
-  free(patternreplacements);
   hs_finder_cleanup(finder);
   return 0;
 }